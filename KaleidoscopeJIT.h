@@ -14,42 +14,138 @@
 #define LLVM_EXECUTIONENGINE_ORC_KALEIDOSCOPEJIT_H
 
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/JITEventListener.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/EPCIndirectionUtils.h"
 #include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
 #include "llvm/ExecutionEngine/Orc/ExecutorProcessControl.h"
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/IRTransformLayer.h"
 #include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LazyReexports.h"
 #include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/Orc/TaskDispatch.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Target/TargetMachine.h"
+#include <atomic>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 namespace llvm {
 namespace orc {
 
+/// Runs ORC materialization tasks on a fixed-size llvm::ThreadPool.
+class ThreadPoolTaskDispatcher : public TaskDispatcher {
+public:
+  ThreadPoolTaskDispatcher(unsigned Threads)
+      : Pool(hardware_concurrency(Threads)) {}
+
+  void dispatch(std::unique_ptr<Task> T) override {
+    // ThreadPool stores tasks in a std::function, which must be copyable.
+    std::shared_ptr<Task> Shared(std::move(T));
+    Pool.async([Shared]() { Shared->run(); });
+  }
+
+  void shutdown() override { Pool.wait(); }
+
+private:
+  ThreadPool Pool;
+};
+
 class KaleidoscopeJIT {
 private:
   std::unique_ptr<ExecutionSession> ES;
+  std::unique_ptr<EPCIndirectionUtils> EPCIU;
+  std::unique_ptr<IndirectStubsManager> Stubs;
+  std::unique_ptr<TargetMachine> TM;
+  JITTargetMachineBuilder TargetBuilder;
+  std::thread::id CreatorThread = std::this_thread::get_id();
+  std::mutex ThreadTargetsMutex;
+  std::map<std::thread::id, std::unique_ptr<TargetMachine>> ThreadTargets;
 
   DataLayout DL;
   MangleAndInterner Mangle;
 
   RTDyldObjectLinkingLayer ObjectLayer;
   IRCompileLayer CompileLayer;
+  IRTransformLayer OptimizeLayer;
+  CompileOnDemandLayer CODLayer;
 
   JITDylib &MainJD;
 
+  bool Lazy = false;
+  bool Concurrent = false;
+  std::function<void(Module &)> Optimizer;
+  std::atomic<unsigned> AddedFunctions{0};
+  std::atomic<unsigned> MaterializedFunctions{0};
+
+  static void handleLazyCallThroughError() {
+    errs() << "LazyCallThrough error: Could not find function body";
+    exit(1);
+  }
+
+  static unsigned countDefinitions(const Module &M) {
+    unsigned Count = 0;
+    for (auto &F : M)
+      if (!F.isDeclaration())
+        ++Count;
+    return Count;
+  }
+
+  /// Start compiling \p Symbols in the background; a later lookup only
+  /// blocks if its symbol is still being compiled.
+  void prefetch(SymbolLookupSet Symbols) {
+    if (Symbols.empty())
+      return;
+    ES->lookup(
+        LookupKind::Static, makeJITDylibSearchOrder(&MainJD),
+        std::move(Symbols), SymbolState::Ready,
+        [this](Expected<SymbolMap> Result) {
+          if (!Result)
+            ES->reportError(Result.takeError());
+        },
+        NoDependenciesToRegister);
+  }
+
+  Expected<ThreadSafeModule> optimizeModule(ThreadSafeModule TSM) {
+    TSM.withModuleDo([this](Module &M) {
+      MaterializedFunctions += countDefinitions(M);
+      if (Optimizer)
+        Optimizer(M);
+    });
+    return TSM;
+  }
+
 public:
   KaleidoscopeJIT(std::unique_ptr<ExecutionSession> ES,
-                  JITTargetMachineBuilder JTMB, DataLayout DL)
-      : ES(std::move(ES)), DL(std::move(DL)), Mangle(*this->ES, this->DL),
+                  std::unique_ptr<EPCIndirectionUtils> EPCIU,
+                  JITTargetMachineBuilder JTMB, std::unique_ptr<TargetMachine> TM,
+                  ObjectCache *Cache = nullptr)
+      : ES(std::move(ES)), EPCIU(std::move(EPCIU)),
+        Stubs(this->EPCIU->createIndirectStubsManager()), TM(std::move(TM)),
+        TargetBuilder(JTMB), DL(this->TM->createDataLayout()), Mangle(*this->ES, this->DL),
         ObjectLayer(*this->ES,
                     []() { return std::make_unique<SectionMemoryManager>(); }),
         CompileLayer(*this->ES, ObjectLayer,
-                     std::make_unique<ConcurrentIRCompiler>(std::move(JTMB))),
+                     std::make_unique<ConcurrentIRCompiler>(JTMB, Cache)),
+        OptimizeLayer(*this->ES, CompileLayer,
+                      [this](ThreadSafeModule TSM,
+                             const MaterializationResponsibility &) {
+                        return optimizeModule(std::move(TSM));
+                      }),
+        CODLayer(*this->ES, OptimizeLayer,
+                 this->EPCIU->getLazyCallThroughManager(),
+                 [this] { return this->EPCIU->createIndirectStubsManager(); }),
         MainJD(this->ES->createBareJITDylib("<main>")) {
     MainJD.addGenerator(
         cantFail(DynamicLibrarySearchGenerator::GetForCurrentProcess(
@@ -63,34 +159,164 @@ public:
   ~KaleidoscopeJIT() {
     if (auto Err = ES->endSession())
       ES->reportError(std::move(Err));
+    if (auto Err = EPCIU->cleanup())
+      ES->reportError(std::move(Err));
   }
 
-  static Expected<std::unique_ptr<KaleidoscopeJIT>> Create() {
-    auto EPC = SelfExecutorProcessControl::Create();
+  /// Create a JIT for the host triple. \p CPU selects the target CPU:
+  /// empty for the generic default, "native" for the host CPU and all of
+  /// its features, or any CPU name known to the target. With a nonzero
+  /// \p Threads, modules are compiled on a pool of that many threads
+  /// instead of on the thread that looks their symbols up. A non-null
+  /// \p Cache is consulted before, and filled after, compiling a module.
+  static Expected<std::unique_ptr<KaleidoscopeJIT>>
+  Create(StringRef CPU = "", unsigned Threads = 0,
+         ObjectCache *Cache = nullptr) {
+    std::unique_ptr<TaskDispatcher> Dispatcher;
+    if (Threads)
+      Dispatcher = std::make_unique<ThreadPoolTaskDispatcher>(Threads);
+    auto EPC = SelfExecutorProcessControl::Create(nullptr, std::move(Dispatcher));
     if (!EPC)
       return EPC.takeError();
 
     auto ES = std::make_unique<ExecutionSession>(std::move(*EPC));
 
+    auto EPCIU = EPCIndirectionUtils::Create(ES->getExecutorProcessControl());
+    if (!EPCIU)
+      return EPCIU.takeError();
+
+    (*EPCIU)->createLazyCallThroughManager(
+        *ES, pointerToJITTargetAddress(&handleLazyCallThroughError));
+
+    if (auto Err = setUpInProcessLCTMReentryViaEPCIU(**EPCIU))
+      return Err;
+
     JITTargetMachineBuilder JTMB(
         ES->getExecutorProcessControl().getTargetTriple());
+    if (CPU == "native") {
+      auto Host = JITTargetMachineBuilder::detectHost();
+      if (!Host)
+        return Host.takeError();
+      JTMB = std::move(*Host);
+    } else if (!CPU.empty()) {
+      JTMB.setCPU(CPU.str());
+    }
 
-    auto DL = JTMB.getDefaultDataLayoutForTarget();
-    if (!DL)
-      return DL.takeError();
+    JTMB.getOptions().GuaranteedTailCallOpt = true;
 
-    return std::make_unique<KaleidoscopeJIT>(std::move(ES), std::move(JTMB),
-                                             std::move(*DL));
+    auto TM = JTMB.createTargetMachine();
+    if (!TM)
+      return TM.takeError();
+
+    auto J = std::make_unique<KaleidoscopeJIT>(std::move(ES), std::move(*EPCIU),
+                                               std::move(JTMB), std::move(*TM),
+                                               Cache);
+    if (Threads)
+      J->Concurrent = true;
+    return J;
   }
 
   const DataLayout &getDataLayout() const { return DL; }
 
+  TargetMachine &getTargetMachine() { return *TM; }
+
+  /// A TargetMachine that only the calling thread uses. TargetMachine is
+  /// not thread-safe, so optimizers running on compile threads must not
+  /// share getTargetMachine() with the thread that created the JIT.
+  /// Returns null if a machine can't be created for this thread.
+  TargetMachine *getThreadTargetMachine() {
+    if (std::this_thread::get_id() == CreatorThread)
+      return TM.get();
+    std::lock_guard<std::mutex> Lock(ThreadTargetsMutex);
+    auto &Target = ThreadTargets[std::this_thread::get_id()];
+    if (!Target) {
+      auto Created = TargetBuilder.createTargetMachine();
+      if (!Created) {
+        consumeError(Created.takeError());
+        return nullptr;
+      }
+      Target = std::move(*Created);
+    }
+    return Target.get();
+  }
+
   JITDylib &getMainJITDylib() { return MainJD; }
 
+  /// In lazy mode each function of an added module is compiled on its
+  /// first call, through a stub managed by the compile-on-demand layer.
+  void setLazy(bool Enabled) { Lazy = Enabled; }
+  bool isLazy() const { return Lazy; }
+
+  /// Run \p Optimize on every module right before it is compiled. Lazy
+  /// mode uses this to optimize each function only once it is needed.
+  void setOptimizer(std::function<void(Module &)> Optimize) {
+    Optimizer = std::move(Optimize);
+  }
+
+  /// Report every object linked from now on to \p Listener, e.g. so that
+  /// perf or gdb can symbolize JIT'd code. \p Listener must outlive the JIT.
+  void addEventListener(JITEventListener &Listener) {
+    ObjectLayer.registerJITEventListener(Listener);
+  }
+
+  /// Number of function definitions handed to addModule.
+  unsigned getAddedFunctions() const { return AddedFunctions; }
+
+  /// Number of function definitions that actually reached the compiler.
+  unsigned getMaterializedFunctions() const { return MaterializedFunctions; }
+
   Error addModule(ThreadSafeModule TSM, ResourceTrackerSP RT = nullptr) {
     if (!RT)
       RT = MainJD.getDefaultResourceTracker();
-    return CompileLayer.add(RT, std::move(TSM));
+    SymbolLookupSet Definitions;
+    TSM.withModuleDo([&](Module &M) {
+      AddedFunctions += countDefinitions(M);
+      if (Concurrent && !Lazy)
+        for (auto &F : M)
+          if (!F.isDeclaration() && F.hasExternalLinkage())
+            Definitions.add(Mangle(F.getName()));
+    });
+    if (Lazy)
+      return CODLayer.add(RT, std::move(TSM));
+    if (auto Err = OptimizeLayer.add(RT, std::move(TSM)))
+      return Err;
+    prefetch(std::move(Definitions));
+    return Error::success();
+  }
+
+  /// Compile \p TSM as a whole even in lazy mode, e.g. for a top-level
+  /// expression that is called once right away and then removed.
+  Error addEagerModule(ThreadSafeModule TSM, ResourceTrackerSP RT = nullptr) {
+    if (!RT)
+      RT = MainJD.getDefaultResourceTracker();
+    TSM.withModuleDo(
+        [this](Module &M) { AddedFunctions += countDefinitions(M); });
+    return OptimizeLayer.add(RT, std::move(TSM));
+  }
+
+  /// Define \p Name as an indirect stub for \p Target. \p Target is only
+  /// looked up, and compiled, on the first call through the stub, so it
+  /// may call functions that are declared but not defined yet. Callers
+  /// linked against \p Name keep calling the stub, so redirectStub can
+  /// swap in a new implementation without relinking them.
+  Error addStub(StringRef Name, StringRef Target) {
+    SymbolAliasMap Aliases;
+    Aliases[Mangle(Name)] = SymbolAliasMapEntry(
+        Mangle(Target), JITSymbolFlags::Exported | JITSymbolFlags::Callable);
+    return MainJD.define(lazyReexports(EPCIU->getLazyCallThroughManager(),
+                                       *Stubs, MainJD, std::move(Aliases)));
+  }
+
+  Error redirectStub(StringRef Name, JITTargetAddress Target) {
+    return Stubs->updatePointer(*Mangle(Name), Target);
+  }
+
+  /// Make the host function at \p Address visible to JIT'd code as \p Name.
+  Error defineAbsolute(StringRef Name, JITTargetAddress Address) {
+    return MainJD.define(absoluteSymbols(
+        {{Mangle(Name),
+          JITEvaluatedSymbol(Address, JITSymbolFlags::Exported |
+                                          JITSymbolFlags::Callable)}}));
   }
 
   Expected<JITEvaluatedSymbol> lookup(StringRef Name) {
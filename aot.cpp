@@ -0,0 +1,73 @@
+#include "aot.h"
+
+#include "code.h"
+
+#include <iostream>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/raw_ostream.h>
+
+std::unique_ptr<llvm::TargetMachine> create_host_target_machine(const std::string& cpu) {
+	auto triple { llvm::sys::getDefaultTargetTriple() };
+	std::string error;
+	auto target { llvm::TargetRegistry::lookupTarget(triple, error) };
+	if (! target) {
+		std::cerr << "Error: " << error << '\n';
+		return nullptr;
+	}
+	std::string name { cpu.empty() ? "generic" : cpu };
+	std::string features;
+	if (name == "native") {
+		name = llvm::sys::getHostCPUName().str();
+		llvm::StringMap<bool> host;
+		if (llvm::sys::getHostCPUFeatures(host)) {
+			for (const auto& feature : host) {
+				features += (feature.getValue() ? "+" : "-") + feature.getKey().str() + ",";
+			}
+		}
+	}
+	return std::unique_ptr<llvm::TargetMachine> { target->createTargetMachine(
+		triple, name, features, llvm::TargetOptions {}, llvm::Reloc::PIC_, std::nullopt, codegen_optimization_level()
+	) };
+}
+
+void add_main(llvm::Module& module, const std::vector<std::string>& expressions) {
+	auto& context { module.getContext() };
+	llvm::IRBuilder<> build { context };
+	auto printf_type { llvm::FunctionType::get(build.getInt32Ty(), { build.getInt8PtrTy() }, true) };
+	auto printf { module.getOrInsertFunction("printf", printf_type) };
+	auto main { llvm::Function::Create(
+		llvm::FunctionType::get(build.getInt32Ty(), false), llvm::Function::ExternalLinkage, "main", module
+	) };
+	build.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", main));
+	auto format { build.CreateGlobalStringPtr("%g\n", "result_format") };
+	auto expression_type { llvm::FunctionType::get(build.getDoubleTy(), false) };
+	for (const auto& name : expressions) {
+		auto expression { module.getOrInsertFunction(name, expression_type) };
+		build.CreateCall(printf, { format, build.CreateCall(expression) });
+	}
+	build.CreateRet(build.getInt32(0));
+	llvm::verifyFunction(*main);
+}
+
+bool emit_object(llvm::Module& module, llvm::TargetMachine& target, const std::string& path) {
+	std::error_code error;
+	llvm::raw_fd_ostream out { path, error, llvm::sys::fs::OF_None };
+	if (error) {
+		std::cerr << "Error: can't open " << path << ": " << error.message() << '\n';
+		return false;
+	}
+	llvm::legacy::PassManager passes;
+	if (target.addPassesToEmitFile(passes, out, nullptr, llvm::CGFT_ObjectFile)) {
+		std::cerr << "Error: the target can't emit an object file\n";
+		return false;
+	}
+	passes.run(module);
+	out.flush();
+	return true;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+std::unique_ptr<llvm::TargetMachine> create_host_target_machine(const std::string& cpu);
+void add_main(llvm::Module& module, const std::vector<std::string>& expressions);
+bool emit_object(llvm::Module& module, llvm::TargetMachine& target, const std::string& path);
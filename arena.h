@@ -0,0 +1,37 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/Support/Allocator.h>
+
+class Arena {
+		llvm::BumpPtrAllocator allocator_;
+
+	public:
+		template<typename T, typename... Args> T* make(Args&&... args) {
+			static_assert(std::is_trivially_destructible_v<T>, "arena objects are never destroyed");
+			return new (allocator_.Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		}
+
+		template<typename T> llvm::ArrayRef<T> copy(llvm::ArrayRef<T> values) {
+			static_assert(std::is_trivially_destructible_v<T>, "arena objects are never destroyed");
+			if (values.empty()) { return { }; }
+			auto data { allocator_.Allocate<T>(values.size()) };
+			std::uninitialized_copy(values.begin(), values.end(), data);
+			return { data, values.size() };
+		}
+
+		std::string_view copy(std::string_view text) {
+			auto data { allocator_.Allocate<char>(text.size()) };
+			std::copy(text.begin(), text.end(), data);
+			return { data, text.size() };
+		}
+
+		void reset() { allocator_.Reset(); }
+		[[nodiscard]] std::size_t bytes() const { return allocator_.getBytesAllocated(); }
+};
@@ -1,15 +1,25 @@
 #include "ast-expression.h"
 #include "code.h"
+#include "memo.h"
+#include "stats.h"
 #include "tok.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <llvm/ADT/APFloat.h>
+#include <llvm/ADT/ScopeExit.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/Casting.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/Verifier.h>
-#include <map>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <array>
+#include <sys/resource.h>
 
 namespace ast {
-	Expression_Ptr log_expression_error(const char* message) {
+	Expression* log_expression_error(const char* message) {
 		std::cerr << "Error: " << message << "\n";
 		return nullptr;
 	}
@@ -19,9 +29,9 @@ namespace ast {
 		return nullptr;
 	}
 
-	static Expression_Ptr parse_number_expression() {
-		auto result { std::make_unique<Number>(value) };
-		next_tok();
+	static Expression* parse_number_expression(Arena& arena) {
+		auto result { arena.make<Number>(tokens.value()) };
+		tokens.next();
 		return result;
 	}
 
@@ -29,62 +39,142 @@ namespace ast {
 		return llvm::ConstantFP::get(*the_context, llvm::APFloat(value_));
 	}
 
+	double Number::evaluate() { return value_; }
+
+	Folded Number::fold(Arena&) { return { this, true }; }
+
 	llvm::Value *log_value_error(const char* msg) {
 		log_expression_error(msg);
 		return nullptr;
 	}
 
-	static std::map<std::string, llvm::Value *> named_values;
+	static std::vector<llvm::Value*> named_values;
+
+	static llvm::Value*& named_value(Symbol name) {
+		if (named_values.size() <= name) { named_values.resize(symbol_count()); }
+		return named_values[name];
+	}
 
 	llvm::Value* Variable::generate_code() {
-		auto value { named_values[name_] };
+		auto value { named_value(name_) };
 		if (! value) { return log_value_error("unknown variable name"); }
 		return value;
 	}
 
-	static Expression_Ptr parse_paren_expression() {
-		next_tok();
-		auto inner { parse_expression() };
-		if (cur_tok != ')') { return log_expression_error("expected ')'"); }
-		next_tok();
-		return inner;
+	// A binding is only visible in the call frame that made it, so a callee
+	// can't see its caller's variables (Kaleidoscope is lexically scoped).
+	struct Binding {
+		double value;
+		bool bound;
+		unsigned depth;
+	};
+
+	static std::vector<Binding> bindings;
+
+	static Binding& binding(Symbol name) {
+		if (bindings.size() <= name) { bindings.resize(symbol_count()); }
+		return bindings[name];
+	}
+
+	static struct {
+		std::uint64_t fuel;
+		bool impure;
+		Evaluation::Status status;
+		unsigned depth;
+		const char* stack_base;
+	} interpreter;
+
+	// Interpreted calls recurse on the native stack; use at most half of it.
+	static std::size_t stack_budget() {
+		static const std::size_t budget { [] {
+			rlimit limit;
+			if (getrlimit(RLIMIT_STACK, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY) {
+				return std::size_t { 8 } << 20;
+			}
+			return static_cast<std::size_t>(limit.rlim_cur) / 2;
+		}() };
+		return budget;
+	}
+
+	static bool stack_exhausted() {
+		char here;
+		return static_cast<std::size_t>(interpreter.stack_base - &here) > stack_budget();
+	}
+
+	static double log_evaluation_error(const char* message) {
+		if (interpreter.status == Evaluation::Status::done) {
+			log_expression_error(message);
+			interpreter.status = Evaluation::Status::failed;
+		}
+		return 0.0;
+	}
+
+	static bool consume_fuel() {
+		if (interpreter.status != Evaluation::Status::done) { return false; }
+		if (interpreter.fuel) { --interpreter.fuel; return true; }
+		if (interpreter.impure) { return true; }
+		interpreter.status = Evaluation::Status::out_of_fuel;
+		return false;
+	}
+
+	static inline bool is_true(double value) { return value < 0.0 || value > 0.0; }
+
+	double Variable::evaluate() {
+		auto& bound { binding(name_) };
+		if (! bound.bound || bound.depth != interpreter.depth) {
+			return log_evaluation_error("unknown variable name");
+		}
+		return bound.value;
+	}
+
+	static std::vector<Symbol> folding_scope;
+
+	// An unknown variable is an error at codegen, so it must not be folded away.
+	Folded Variable::fold(Arena&) {
+		auto known { std::find(folding_scope.begin(), folding_scope.end(), name_) != folding_scope.end() };
+		return { this, known };
+	}
+
+	static bool is_constant(const Folded& folded, double value) {
+		auto number { llvm::dyn_cast<Number>(folded.expression) };
+		return number && number->value() == value && std::signbit(number->value()) == std::signbit(value);
 	}
 
-	static Expression_Ptr parse_identifier_expression() {
-		auto name = identifier;
-		next_tok();
-		if (cur_tok != '(') { return std::make_unique<Variable>(name); };
-		next_tok();
-		std::vector<Expression_Ptr> args;
-		if (cur_tok != ')') {
+	static Expression* parse_identifier_expression(Arena& arena) {
+		auto name { tokens.symbol() };
+		tokens.next();
+		if (tokens.kind() != '(') { return arena.make<Variable>(name); };
+		tokens.next();
+		llvm::SmallVector<Expression*, 8> args;
+		if (tokens.kind() != ')') {
 			for (;;) {
-				if (auto arg { parse_expression() }) {
-					args.push_back(std::move(arg));
+				if (auto arg { parse_expression(arena) }) {
+					args.push_back(arg);
 				} else { return nullptr; }
-				if (cur_tok == ')') { break; }
-				if (cur_tok != ',') {
+				if (tokens.kind() == ')') { break; }
+				if (tokens.kind() != ',') {
 					return log_expression_error("expected ')' or ',' in argument list");
 				}
-				next_tok();
+				tokens.next();
 			}
 		}
-		next_tok();
-		return std::make_unique<Call>(name, std::move(args));
+		tokens.next();
+		return arena.make<Call>(name, arena.copy<Expression*>(args));
 	}
 
-	static Expression_Ptr parse_if_expression() {
-		next_tok();
-		auto condition { parse_expression() };
+	static Expression* parse_if_expression(Arena& arena) {
+		tokens.next();
+		auto condition { parse_expression(arena) };
 		if (! condition) { return nullptr; }
-		if (cur_tok != tok_then) { return log_expression_error("expected then"); }
-		next_tok();
-		auto then { parse_expression() };
+		if (tokens.kind() != tok_then) { return log_expression_error("expected then"); }
+		tokens.next();
+		auto then { parse_expression(arena) };
 		if (! then) { return nullptr; }
-		if (cur_tok != tok_else) { return log_expression_error("expected else"); }
-		next_tok();
-		auto els { parse_expression() };
+		if (tokens.kind() != tok_else) { return log_expression_error("expected else"); }
+		tokens.next();
+		auto els { parse_expression(arena) };
 		if (! els) { return nullptr; }
-		return std::make_unique<If>(std::move(condition), std::move(then), std::move(els));
+		return arena.make<If>(condition, then, els);
 	}
 
 	llvm::Value* If::generate_code() {
@@ -117,36 +207,70 @@ namespace ast {
 		return pn;
 	}
 
-	static Expression_Ptr parse_for_expression() {
-		next_tok();
-		if (cur_tok != tok_identifier) {
+	static bool generate_return(Expression* expression);
+
+	bool If::generate_returns() {
+		auto condition_value { condition_->generate_code() };
+		if (! condition_value) { return false; }
+		condition_value = builder->CreateFCmpONE(condition_value, llvm::ConstantFP::get(*the_context, llvm::APFloat(0.0)), "ifcond");
+		auto the_function { builder->GetInsertBlock()->getParent() };
+		auto then_bb { llvm::BasicBlock::Create(*the_context, "then", the_function) };
+		auto else_bb { llvm::BasicBlock::Create(*the_context, "else", the_function) };
+		builder->CreateCondBr(condition_value, then_bb, else_bb);
+		builder->SetInsertPoint(then_bb);
+		if (! generate_return(then_)) { return false; }
+		builder->SetInsertPoint(else_bb);
+		return generate_return(else_);
+	}
+
+	double If::evaluate() {
+		return is_true(condition_->evaluate()) ? then_->evaluate() : else_->evaluate();
+	}
+
+	Folded If::fold(Arena& arena) {
+		auto condition { condition_->fold(arena) };
+		auto then { then_->fold(arena) };
+		auto els { else_->fold(arena) };
+		// The untaken branch must still compile, so only drop it if it can't fail.
+		if (auto number { llvm::dyn_cast<Number>(condition.expression) }) {
+			auto taken { is_true(number->value()) };
+			if ((taken ? els : then).pure) { return taken ? then : els; }
+		}
+		auto pure { condition.pure && then.pure && els.pure };
+		if (condition.expression == condition_ && then.expression == then_ && els.expression == else_) {
+			return { this, pure };
+		}
+		return { arena.make<If>(condition.expression, then.expression, els.expression), pure };
+	}
+
+	static Expression* parse_for_expression(Arena& arena) {
+		tokens.next();
+		if (tokens.kind() != tok_identifier) {
 			return log_expression_error("expected identifier after for");
 		}
-		auto id_name = identifier;
-		next_tok();
-		if (cur_tok != '=')  { return log_expression_error("expected '=' after for"); }
-		next_tok();
-		auto start = parse_expression();
+		auto id_name { tokens.symbol() };
+		tokens.next();
+		if (tokens.kind() != '=')  { return log_expression_error("expected '=' after for"); }
+		tokens.next();
+		auto start = parse_expression(arena);
 		if (! start) { return nullptr; }
-		if (cur_tok != ',') {
+		if (tokens.kind() != ',') {
 			return log_expression_error("expected ',' after for start value");
 		}
-		next_tok();
-		auto end = parse_expression();
+		tokens.next();
+		auto end = parse_expression(arena);
 		if (! end) { return nullptr; }
-		Expression_Ptr step;
-		if (cur_tok == ',') {
-			next_tok();
-			step = parse_expression();
+		Expression* step { nullptr };
+		if (tokens.kind() == ',') {
+			tokens.next();
+			step = parse_expression(arena);
 			if (! step) { return nullptr; }
 		}
-		if (cur_tok != tok_in) { return log_expression_error("expected 'in' after for"); }
-		next_tok();
-		auto body = parse_expression();
+		if (tokens.kind() != tok_in) { return log_expression_error("expected 'in' after for"); }
+		tokens.next();
+		auto body = parse_expression(arena);
 		if (! body) { return nullptr; }
-		return std::make_unique<For>(
-			id_name, std::move(start), std::move(end), std::move(step), std::move(body)
-		);
+		return arena.make<For>(id_name, start, end, step, body);
 	}
 
 	llvm::Value* For::generate_code() {
@@ -157,10 +281,11 @@ namespace ast {
 		auto loop_bb { llvm::BasicBlock::Create(*the_context, "loop", the_function) };
 		builder->CreateBr(loop_bb);
 		builder->SetInsertPoint(loop_bb);
-		auto variable { builder->CreatePHI(llvm::Type::getDoubleTy(*the_context), 2, var_name_) };
+		auto variable { builder->CreatePHI(llvm::Type::getDoubleTy(*the_context), 2, symbol_name(var_name_)) };
 		variable->addIncoming(start_val, preheader_bb);
-		auto old_value { named_values[var_name_] };
-		named_values[var_name_] = variable;
+		auto old_value { named_value(var_name_) };
+		named_value(var_name_) = variable;
+		auto restore { llvm::make_scope_exit([&] { named_value(var_name_) = old_value; }) };
 		if (! body_->generate_code()) { return nullptr; }
 		llvm::Value* step_value;
 		if (step_) {
@@ -176,76 +301,398 @@ namespace ast {
 		builder->CreateCondBr(end_condition, loop_bb, after_bb);
 		builder->SetInsertPoint(after_bb);
 		variable->addIncoming(next_var, loop_end_bb);
-		if (old_value) {
-			named_values[var_name_] = old_value;
-		} else {
-			named_values.erase(var_name_);
-		}
 		return llvm::Constant::getNullValue(llvm::Type::getDoubleTy(*the_context));
 	}
 
-	static Expression_Ptr parse_primary() {
-		switch (cur_tok) {
+	double For::evaluate() {
+		auto start { start_->evaluate() };
+		auto old_binding { binding(var_name_) };
+		binding(var_name_) = { start, true, interpreter.depth };
+		while (consume_fuel()) {
+			body_->evaluate();
+			auto next { binding(var_name_).value + (step_ ? step_->evaluate() : 1.0) };
+			if (! is_true(end_->evaluate())) { break; }
+			binding(var_name_).value = next;
+		}
+		binding(var_name_) = old_binding;
+		return 0.0;
+	}
+
+	Folded For::fold(Arena& arena) {
+		auto start { start_->fold(arena) };
+		folding_scope.push_back(var_name_);
+		auto end { end_->fold(arena) };
+		Folded step { nullptr, true };
+		if (step_) { step = step_->fold(arena); }
+		auto body { body_->fold(arena) };
+		folding_scope.pop_back();
+		// The body runs before the first test, so a false end runs it exactly once.
+		auto number { llvm::dyn_cast<Number>(end.expression) };
+		if (number && ! is_true(number->value()) && start.pure && step.pure && body.pure) {
+			return { arena.make<Number>(0.0), true };
+		}
+		if (
+			start.expression == start_ && end.expression == end_ &&
+			step.expression == step_ && body.expression == body_
+		) { return { this, false }; }
+		return { arena.make<For>(var_name_, start.expression, end.expression, step.expression, body.expression), false };
+	}
+
+	static Expression* parse_primary(Arena& arena) {
+		switch (tokens.kind()) {
 			case tok_identifier:
-				return parse_identifier_expression();
+				return parse_identifier_expression(arena);
 			case tok_number:
-				return parse_number_expression();
-			case '(':
-				return parse_paren_expression();
+				return parse_number_expression(arena);
+			case tok_bad_number:
+				return log_expression_error("malformed number");
 			case tok_if:
-				return parse_if_expression();
+				return parse_if_expression(arena);
 			case tok_for:
-				return parse_for_expression();
+				return parse_for_expression(arena);
 			default:
 				return log_expression_error("unknown token when expecting expression");
 		}
 	}
 
-	static std::map<char, int> binary_op_precendence {
-		{ '<', 10 }, { '+', 20 }, { '-', 20 }, { '*', 40 }
+	struct Module_Function {
+		llvm::Function* function;
+		unsigned generation;
+	};
+
+	struct Operator {
+		int precedence;
+		struct {
+			bool defined;
+			Symbol symbol;
+			Module_Function resolved;
+		} functions[2];
 	};
 
+	static std::array<Operator, 128> operators { [] {
+		std::array<Operator, 128> table { };
+		table['<'].precedence = 10;
+		table['+'].precedence = 20;
+		table['-'].precedence = 20;
+		table['*'].precedence = 40;
+		return table;
+	}() };
+
+	static inline bool is_operator_char(int tok) {
+		return tok >= 0 && tok < static_cast<int>(operators.size());
+	}
+
+	static void define_operator(char op, unsigned arity, Symbol symbol, unsigned precedence) {
+		auto& descriptor { operators[static_cast<unsigned char>(op)] };
+		if (arity == 2) { descriptor.precedence = static_cast<int>(precedence); }
+		descriptor.functions[arity - 1] = { true, symbol, { nullptr, 0 } };
+	}
+
 	static int get_tok_precedence() {
-		if (! isascii(cur_tok)) { return -1; }
-		auto precedence { binary_op_precendence[cur_tok] };
+		auto tok { tokens.kind() };
+		if (! is_operator_char(tok)) { return -1; }
+		auto precedence { operators[tok].precedence };
 		return precedence <= 0 ? -1 : precedence;
 	}
 
-	static Expression_Ptr parse_binary_op_right(int precedence, Expression_Ptr left) {
+	struct Pending_Operator {
+		enum class Kind { paren, unary, binary } kind;
+		char op;
+		int precedence;
+	};
+
+	static Expression* parse_operators(Arena& arena) {
+		llvm::SmallVector<Expression*, 16> operands;
+		llvm::SmallVector<Pending_Operator, 16> pending;
+		unsigned open_parens { 0 };
+
+		auto reduce_binary { [&] {
+			auto op { pending.pop_back_val().op };
+			auto right { operands.pop_back_val() };
+			operands.back() = arena.make<Binary>(op, operands.back(), right);
+		} };
+		auto reduce_unary { [&] {
+			while (! pending.empty() && pending.back().kind == Pending_Operator::Kind::unary) {
+				operands.back() = arena.make<Unary>(pending.pop_back_val().op, operands.back());
+			}
+		} };
+		auto reduce_to_paren { [&] {
+			while (! pending.empty() && pending.back().kind == Pending_Operator::Kind::binary) {
+				reduce_binary();
+			}
+		} };
+
 		for (;;) {
-			auto tok_prec { get_tok_precedence() };
-			if (tok_prec < precedence) {
-				return left;
+			for (;;) {
+				auto tok { tokens.kind() };
+				if (tok == '(') {
+					pending.push_back({ Pending_Operator::Kind::paren, '(', 0 });
+					++open_parens;
+				} else if (is_operator_char(tok) && operators[tok].functions[0].defined) {
+					pending.push_back({ Pending_Operator::Kind::unary, static_cast<char>(tok), 0 });
+				} else { break; }
+				tokens.next();
 			}
-			int op { cur_tok };
-			next_tok();
-			auto right { parse_primary() };
-			if (! right) { return nullptr; }
-			int next_prec { get_tok_precedence() };
-			if (tok_prec < next_prec) {
-				right = parse_binary_op_right(tok_prec + 1, std::move(right));
-				if (! right) { return nullptr; }
+			auto operand { parse_primary(arena) };
+			if (! operand) { return nullptr; }
+			operands.push_back(operand);
+			reduce_unary();
+
+			for (;;) {
+				auto precedence { get_tok_precedence() };
+				if (precedence > 0) {
+					auto op { static_cast<char>(tokens.kind()) };
+					// Binary operators are left-associative.
+					while (
+						! pending.empty() && pending.back().kind == Pending_Operator::Kind::binary &&
+						pending.back().precedence >= precedence
+					) { reduce_binary(); }
+					pending.push_back({ Pending_Operator::Kind::binary, op, precedence });
+					tokens.next();
+					break;
+				}
+				reduce_to_paren();
+				if (! open_parens) { return operands.back(); }
+				if (tokens.kind() != ')') { return log_expression_error("expected ')'"); }
+				tokens.next();
+				pending.pop_back();
+				--open_parens;
+				reduce_unary();
 			}
-			left = std::make_unique<Binary>(op, std::move(left), std::move(right));
 		}
 	}
 
-	std::map<std::string, Prototype_Ptr> FunctionProtos;
+	static std::vector<Prototype_Ptr> function_protos;
+
+	Prototype_Ptr add_prototype(Prototype_Ptr prototype) {
+		auto name { prototype->symbol() };
+		if (function_protos.size() <= name) { function_protos.resize(name + 1); }
+		auto& previous { function_protos[name] };
+		// Keep the calling convention earlier callers were compiled against.
+		if (previous) { prototype->set_internal(previous->is_internal()); }
+		std::swap(previous, prototype);
+		return prototype;
+	}
+
+	static std::vector<Function_Ptr> definitions;
+
+	void define_function(Function_Ptr function) {
+		function->retain();
+		function->declare();
+		auto name { function->prototype().symbol() };
+		if (definitions.size() <= name) { definitions.resize(name + 1); }
+		definitions[name] = std::move(function);
+	}
+
+	Function* defined_function(Symbol name) {
+		return name < definitions.size() ? definitions[name].get() : nullptr;
+	}
+
+	static std::vector<void*> extern_addresses;
 
-	static llvm::Function* get_function(std::string name) {
-		if (auto* f = the_module->getFunction(name)) { return f; }
-		auto fi { FunctionProtos.find(name) };
-		if (fi != FunctionProtos.end()) {
-			return fi->second->generate_code();
+	static double call_extern(const Prototype& prototype, llvm::ArrayRef<double> args) {
+		if (extern_addresses.size() <= prototype.symbol()) { extern_addresses.resize(symbol_count()); }
+		auto& address { extern_addresses[prototype.symbol()] };
+		if (! address) {
+			static bool process_loaded { ! llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr) };
+			if (process_loaded) {
+				address = llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(std::string { prototype.name() });
+			}
+			if (! address) { return log_evaluation_error("unknown external function"); }
+		}
+		interpreter.impure = true;
+		switch (args.size()) {
+			case 0: return reinterpret_cast<double (*)()>(address)();
+			case 1: return reinterpret_cast<double (*)(double)>(address)(args[0]);
+			case 2: return reinterpret_cast<double (*)(double, double)>(address)(args[0], args[1]);
+			case 3:
+				return reinterpret_cast<double (*)(double, double, double)>(address)(args[0], args[1], args[2]);
+			case 4:
+				return reinterpret_cast<double (*)(double, double, double, double)>(address)(
+					args[0], args[1], args[2], args[3]
+				);
+			default: return log_evaluation_error("too many arguments for an external function");
+		}
+	}
+
+	static double call_function(Symbol name, llvm::ArrayRef<double> args) {
+		if (! consume_fuel()) { return 0.0; }
+		if (name < definitions.size() && definitions[name]) {
+			auto& function { *definitions[name] };
+			auto& params { function.prototype().args() };
+			if (params.size() != args.size()) {
+				return log_evaluation_error("incorrect numbers of arguments passed");
+			}
+			if (stack_exhausted()) {
+				// Without side effects yet, --exec=auto can still run it compiled.
+				if (interpreter.impure) { return log_evaluation_error("call depth limit exceeded"); }
+				interpreter.status = Evaluation::Status::too_deep;
+				return 0.0;
+			}
+			llvm::SmallVector<Binding, 8> saved;
+			++interpreter.depth;
+			for (unsigned i { 0 }; i < params.size(); ++i) {
+				saved.push_back(binding(params[i]));
+				binding(params[i]) = { args[i], true, interpreter.depth };
+			}
+			auto result { function.body()->evaluate() };
+			for (auto i { params.size() }; i-- > 0;) { binding(params[i]) = saved[i]; }
+			--interpreter.depth;
+			return result;
+		}
+		if (name < function_protos.size() && function_protos[name]) {
+			if (function_protos[name]->args().size() != args.size()) {
+				return log_evaluation_error("incorrect numbers of arguments passed");
+			}
+			return call_extern(*function_protos[name], args);
+		}
+		return log_evaluation_error("unknown function referenced");
+	}
+
+	static std::vector<Module_Function> module_functions;
+
+	static llvm::Function* module_function(Symbol name) {
+		if (name >= module_functions.size()) { return nullptr; }
+		auto& entry { module_functions[name] };
+		return entry.generation == module_generation ? entry.function : nullptr;
+	}
+
+	static void set_module_function(Symbol name, llvm::Function* function) {
+		if (module_functions.size() <= name) { module_functions.resize(symbol_count()); }
+		module_functions[name] = { function, module_generation };
+	}
+
+	static llvm::Function* get_function(Symbol name) {
+		if (auto f { module_function(name) }) { return f; }
+		if (name < function_protos.size() && function_protos[name]) {
+			return function_protos[name]->generate_code();
 		}
 		return nullptr;
 	}
 
-	llvm::Value* Binary::generate_code() {
-		auto left { left_hand_side_->generate_code() };
-		auto right { right_hand_side_->generate_code() };
-		if (! left || ! right) { return nullptr; }
+	static llvm::CallInst* generate_call(llvm::Function* callee, llvm::ArrayRef<llvm::Value*> args, const char* name) {
+		auto call { builder->CreateCall(callee, args, name) };
+		call->setCallingConv(callee->getCallingConv());
+		return call;
+	}
+
+	static llvm::Function* operator_function(char op, unsigned arity) {
+		auto& function { operators[static_cast<unsigned char>(op)].functions[arity - 1] };
+		if (! function.defined) { return nullptr; }
+		if (function.resolved.generation != module_generation || ! function.resolved.function) {
+			function.resolved = { get_function(function.symbol), module_generation };
+		}
+		return function.resolved.function;
+	}
+
+	static llvm::Value* generate_operator_code(Expression* root) {
+		struct Step {
+			Expression* node;
+			bool operands_ready;
+		};
+		llvm::SmallVector<Step, 32> steps { { root, false } };
+		llvm::SmallVector<llvm::Value*, 32> values;
+
+		while (! steps.empty()) {
+			auto [node, operands_ready] { steps.pop_back_val() };
+			if (auto binary { llvm::dyn_cast<Binary>(node) }) {
+				if (! operands_ready) {
+					steps.push_back({ node, true });
+					steps.push_back({ binary->right_hand_side(), false });
+					steps.push_back({ binary->left_hand_side(), false });
+					continue;
+				}
+				auto right { values.pop_back_val() };
+				auto result { binary->generate_code(values.back(), right) };
+				if (! result) { return nullptr; }
+				values.back() = result;
+			} else if (auto unary { llvm::dyn_cast<Unary>(node) }) {
+				if (! operands_ready) {
+					steps.push_back({ node, true });
+					steps.push_back({ unary->right_hand_side(), false });
+					continue;
+				}
+				auto result { unary->generate_code(values.back()) };
+				if (! result) { return nullptr; }
+				values.back() = result;
+			} else {
+				auto result { node->generate_code() };
+				if (! result) { return nullptr; }
+				values.push_back(result);
+			}
+		}
+		return values.back();
+	}
+
+	static double evaluate_operators(Expression* root) {
+		struct Step {
+			Expression* node;
+			bool operands_ready;
+		};
+		llvm::SmallVector<Step, 32> steps { { root, false } };
+		llvm::SmallVector<double, 32> values;
+
+		while (! steps.empty()) {
+			auto [node, operands_ready] { steps.pop_back_val() };
+			if (auto binary { llvm::dyn_cast<Binary>(node) }) {
+				if (! operands_ready) {
+					steps.push_back({ node, true });
+					steps.push_back({ binary->right_hand_side(), false });
+					steps.push_back({ binary->left_hand_side(), false });
+					continue;
+				}
+				auto right { values.pop_back_val() };
+				values.back() = binary->evaluate(values.back(), right);
+			} else if (auto unary { llvm::dyn_cast<Unary>(node) }) {
+				if (! operands_ready) {
+					steps.push_back({ node, true });
+					steps.push_back({ unary->right_hand_side(), false });
+					continue;
+				}
+				values.back() = unary->evaluate(values.back());
+			} else {
+				values.push_back(node->evaluate());
+			}
+		}
+		return values.back();
+	}
+
+	static Folded fold_operators(Expression* root, Arena& arena) {
+		struct Step {
+			Expression* node;
+			bool operands_ready;
+		};
+		llvm::SmallVector<Step, 32> steps { { root, false } };
+		llvm::SmallVector<Folded, 32> values;
 
+		while (! steps.empty()) {
+			auto [node, operands_ready] { steps.pop_back_val() };
+			if (auto binary { llvm::dyn_cast<Binary>(node) }) {
+				if (! operands_ready) {
+					steps.push_back({ node, true });
+					steps.push_back({ binary->right_hand_side(), false });
+					steps.push_back({ binary->left_hand_side(), false });
+					continue;
+				}
+				auto right { values.pop_back_val() };
+				values.back() = binary->fold(values.back(), right, arena);
+			} else if (auto unary { llvm::dyn_cast<Unary>(node) }) {
+				if (! operands_ready) {
+					steps.push_back({ node, true });
+					steps.push_back({ unary->right_hand_side(), false });
+					continue;
+				}
+				values.back() = unary->fold(values.back(), arena);
+			} else {
+				values.push_back(node->fold(arena));
+			}
+		}
+		return values.back();
+	}
+
+	llvm::Value* Binary::generate_code() { return generate_operator_code(this); }
+
+	llvm::Value* Binary::generate_code(llvm::Value* left, llvm::Value* right) {
 		switch (op_) {
 			case '+': return builder->CreateFAdd(left, right, "addtemp");
 			case '-': return builder->CreateFSub(left, right, "subtemp");
@@ -256,10 +703,83 @@ namespace ast {
 			default: break;
 		}
 
-		auto* f { get_function(std::string("binary") + op_) };
+		auto* f { operator_function(op_, 2) };
 		assert(f && "binary operator not found!");
 		llvm::Value* ops[2] { left, right };
-		return builder->CreateCall(f, ops, "binop");
+		return generate_call(f, ops, "binop");
+	}
+
+	double Binary::evaluate() { return evaluate_operators(this); }
+
+	double Binary::evaluate(double left, double right) {
+		switch (op_) {
+			case '+': return left + right;
+			case '-': return left - right;
+			case '*': return left * right;
+			case '<': return left >= right ? 0.0 : 1.0;
+			default: break;
+		}
+
+		auto& function { operators[static_cast<unsigned char>(op_)].functions[1] };
+		if (! function.defined) { return log_evaluation_error("binary operator not found"); }
+		double args[2] { left, right };
+		return call_function(function.symbol, args);
+	}
+
+	Folded Binary::fold(Arena& arena) { return fold_operators(this, arena); }
+
+	// Only identities that hold for every double, including -0, infinities and NaN.
+	Folded Binary::fold(Folded left, Folded right, Arena& arena) {
+		auto built_in { op_ == '+' || op_ == '-' || op_ == '*' || op_ == '<' };
+		if (! built_in) {
+			if (left.expression == left_hand_side_ && right.expression == right_hand_side_) { return { this, false }; }
+			return { arena.make<Binary>(op_, left.expression, right.expression), false };
+		}
+		auto left_number { llvm::dyn_cast<Number>(left.expression) };
+		auto right_number { llvm::dyn_cast<Number>(right.expression) };
+		if (left_number && right_number) {
+			return { arena.make<Number>(evaluate(left_number->value(), right_number->value())), true };
+		}
+		auto pure { left.pure && right.pure };
+		switch (op_) {
+			case '*':
+				if (is_constant(right, 1.0)) { return left; }
+				if (is_constant(left, 1.0)) { return right; }
+				break;
+			case '-':
+				if (is_constant(right, 0.0)) { return left; }
+				break;
+			case '+':
+				if (is_constant(right, -0.0)) { return left; }
+				if (is_constant(left, -0.0)) { return right; }
+				break;
+			default: break;
+		}
+		if (left.expression == left_hand_side_ && right.expression == right_hand_side_) { return { this, pure }; }
+		return { arena.make<Binary>(op_, left.expression, right.expression), pure };
+	}
+
+	llvm::Value* Unary::generate_code() { return generate_operator_code(this); }
+
+	llvm::Value* Unary::generate_code(llvm::Value* operand) {
+		auto* f { operator_function(op_, 1) };
+		if (! f) { return log_value_error("unknown unary operator"); }
+		return generate_call(f, operand, "unop");
+	}
+
+	double Unary::evaluate() { return evaluate_operators(this); }
+
+	double Unary::evaluate(double operand) {
+		auto& function { operators[static_cast<unsigned char>(op_)].functions[0] };
+		if (! function.defined) { return log_evaluation_error("unknown unary operator"); }
+		return call_function(function.symbol, operand);
+	}
+
+	Folded Unary::fold(Arena& arena) { return fold_operators(this, arena); }
+
+	Folded Unary::fold(Folded operand, Arena& arena) {
+		if (operand.expression == right_hand_side_) { return { this, false }; }
+		return { arena.make<Unary>(op_, operand.expression), false };
 	}
 
 	llvm::Value* Call::generate_code() {
@@ -269,54 +789,165 @@ namespace ast {
 			return log_value_error("incorrect numbers of arguments passed");
 		}
 		std::vector<llvm::Value *> args;
-		for (auto &arg : args_) {
+		for (auto arg : args_) {
 			args.push_back(arg->generate_code());
 			if (! args.back()) { return nullptr; }
 		}
-		return builder->CreateCall(callee, args, "calltmp");
+		return generate_call(callee, args, "calltmp");
+	}
+
+	double Call::evaluate() {
+		llvm::SmallVector<double, 8> args;
+		for (auto arg : args_) { args.push_back(arg->evaluate()); }
+		return call_function(callee_, args);
+	}
+
+	Folded Call::fold(Arena& arena) {
+		llvm::SmallVector<Expression*, 8> args;
+		auto changed { false };
+		for (auto arg : args_) {
+			args.push_back(arg->fold(arena).expression);
+			changed = changed || args.back() != arg;
+		}
+		if (! changed) { return { this, false }; }
+		return { arena.make<Call>(callee_, arena.copy<Expression*>(args)), false };
 	}
 
-	Expression_Ptr parse_expression() {
-		auto left { parse_primary() };
-		if (! left) { return nullptr; }
-		return parse_binary_op_right(0, std::move(left));
+	Expression* parse_expression(Arena& arena) {
+		return parse_operators(arena);
 	}
 
 	llvm::Function *Prototype::generate_code() {
 		std::vector<llvm::Type *> doubles(args_.size(), llvm::Type::getDoubleTy(*the_context));
 		auto ft { llvm::FunctionType::get(llvm::Type::getDoubleTy(*the_context), doubles, false) };
-		auto f { llvm::Function::Create(ft, llvm::Function::ExternalLinkage, name_, the_module.get()) };
+		auto f { llvm::Function::Create(ft, llvm::Function::ExternalLinkage, name(), the_module.get()) };
+		if (internal_ && fast_calls) { f->setCallingConv(llvm::CallingConv::Fast); }
+		if (keep_frame_pointers) { f->addFnAttr("frame-pointer", "all"); }
 		unsigned idx { 0 };
 		for (auto &arg : f->args()) {
-			arg.setName(args_[idx++]);
+			arg.setName(symbol_name(args_[idx++]));
 		}
+		set_module_function(name_, f);
 		return f;
 	}
 
+	void Function::declare() {
+		if (! prototype_) { return; }
+		declared_ = prototype_.get();
+		replaced_ = add_prototype(std::move(prototype_));
+		auto& p { *declared_ };
+		if (p.is_binary_op() || p.is_unary_op()) {
+			define_operator(p.operator_name(), p.args().size(), p.symbol(), p.binary_precedence());
+		}
+	}
+
+	static struct {
+		llvm::Function* function;
+		llvm::BasicBlock* header;
+		llvm::SmallVector<llvm::PHINode*, 4> args;
+		bool used;
+	} tail_recursion;
+
+	static bool generate_return(Expression* expression) {
+		if (auto branch { llvm::dyn_cast<If>(expression) }) { return branch->generate_returns(); }
+		auto value { expression->generate_code() };
+		if (! value) { return false; }
+		auto call { llvm::dyn_cast<llvm::CallInst>(value) };
+		if (! call || call != &builder->GetInsertBlock()->back()) {
+			builder->CreateRet(value);
+			return true;
+		}
+		if (call->getCalledFunction() == tail_recursion.function) {
+			for (unsigned i { 0 }; i < call->arg_size(); ++i) {
+				tail_recursion.args[i]->addIncoming(call->getArgOperand(i), builder->GetInsertBlock());
+			}
+			call->eraseFromParent();
+			builder->CreateBr(tail_recursion.header);
+			tail_recursion.used = true;
+			return true;
+		}
+		call->setTailCall();
+		builder->CreateRet(call);
+		return true;
+	}
+
 	llvm::Function* Function::generate_code() {
-		auto& p { *prototype_ };
-		FunctionProtos[p.name()] = std::move(prototype_);
-		auto fn { the_module->getFunction(p.name()) };
+		Phase_Timer timer { Phase::codegen };
+		declare();
+		auto& p { *declared_ };
+		auto fn { module_function(p.symbol()) };
 		if (! fn) { fn = p.generate_code(); };
 		if (! fn) { return nullptr; }
-		if (p.is_binary_op()) {
-			binary_op_precendence[p.operator_name()] = p.binary_precedence();
+
+		if (fold_expressions()) {
+			folding_scope.assign(p.args().begin(), p.args().end());
+			body_ = body_->fold(arena_).expression;
+			folding_scope.clear();
 		}
 
 		auto bb { llvm::BasicBlock::Create(*the_context, "entry", fn) };
+		auto header { llvm::BasicBlock::Create(*the_context, "tailrecurse", fn) };
 		builder->SetInsertPoint(bb);
+		builder->CreateBr(header);
+		builder->SetInsertPoint(header);
+		tail_recursion = { fn, header, { }, false };
 
-		named_values.clear();
+		unsigned idx { 0 };
 		for (auto &arg : fn->args()) {
-			named_values[std::string(arg.getName())] = &arg;
+			auto phi { builder->CreatePHI(arg.getType(), 2, arg.getName()) };
+			phi->addIncoming(&arg, bb);
+			tail_recursion.args.push_back(phi);
+			named_value(p.args()[idx++]) = phi;
+		}
+		auto generated { generate_return(body_) };
+		for (auto arg : p.args()) { named_value(arg) = nullptr; }
+		if (! retained_) {
+			body_ = nullptr;
+			arena_.reset();
 		}
-		if (auto retval { body_->generate_code() }) {
-			builder->CreateRet(retval);
+		if (generated) {
+			if (! tail_recursion.used) {
+				for (auto phi : tail_recursion.args) {
+					phi->replaceAllUsesWith(phi->getIncomingValue(0));
+					phi->eraseFromParent();
+				}
+				llvm::MergeBlockIntoPredecessor(header);
+			}
 			llvm::verifyFunction(*fn);
-			the_fpm->run(*fn);
-			return fn;
+			auto memoized { memoize(*fn) };
+			if (memoized != fn) { set_module_function(p.symbol(), memoized); }
+			if (optimize_each_function) {
+				optimize_function(*fn);
+				if (memoized != fn) { optimize_function(*memoized); }
+			}
+			return memoized;
 		}
+		// The erased function's values may still be bound; forget all of them.
+		std::fill(named_values.begin(), named_values.end(), nullptr);
 		fn->eraseFromParent();
+		set_module_function(p.symbol(), nullptr);
+		undeclare();
 		return nullptr;
 	}
+
+	// A failed redefinition must not replace the prototype the previous
+	// definition (and code compiled against it) still uses.
+	void Function::undeclare() {
+		if (! declared_ || ! replaced_) { return; }
+		auto name { declared_->symbol() };
+		prototype_ = std::move(function_protos[name]);
+		function_protos[name] = std::move(replaced_);
+		declared_ = nullptr;
+		auto& restored { *function_protos[name] };
+		if (restored.is_binary_op() || restored.is_unary_op()) {
+			define_operator(restored.operator_name(), restored.args().size(), name, restored.binary_precedence());
+		}
+	}
+
+	Evaluation Function::evaluate(std::uint64_t fuel) {
+		char base;
+		interpreter = { fuel, false, Evaluation::Status::done, 0, &base };
+		auto value { body_->evaluate() };
+		return { interpreter.status, value };
+	}
 }
\ No newline at end of file
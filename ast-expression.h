@@ -1,132 +1,190 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
-#include <map>
 #include <memory>
 #include <vector>
 
+#include <llvm/ADT/ArrayRef.h>
 #include <llvm/IR/Value.h>
 
+#include "arena.h"
+#include "symbol.h"
+
 namespace ast {
+	class Expression;
+
+	struct Folded {
+		Expression* expression;
+		bool pure;
+	};
+
 	class Expression {
 		public:
-			virtual ~Expression() = default;
+			enum class Kind { number, variable, binary, unary, call, if_then_else, for_loop };
+
+		private:
+			Kind kind_;
+
+		protected:
+			explicit Expression(Kind kind): kind_ { kind } { }
+			~Expression() = default;
+
+		public:
+			[[nodiscard]] Kind kind() const { return kind_; }
 			virtual llvm::Value* generate_code() = 0;
+			virtual double evaluate() = 0;
+			virtual Folded fold(Arena& arena) = 0;
 	};
 
-	using Expression_Ptr = std::unique_ptr<Expression>;
-
-	Expression_Ptr log_expression_error(const char* message);
+	Expression* log_expression_error(const char* message);
 
 	class Number: public Expression {
 			double value_;
 
 		public:
-			explicit Number(double value): value_ { value } { }
+			explicit Number(double value): Expression { Kind::number }, value_ { value } { }
+			static bool classof(const Expression* e) { return e->kind() == Kind::number; }
+
+			[[nodiscard]] double value() const { return value_; }
 			llvm::Value* generate_code() override;
+			double evaluate() override;
+			Folded fold(Arena& arena) override;
 	};
 
 	class Variable: public Expression {
-			std::string name_;
+			Symbol name_;
 
 		public:
-			explicit Variable(std::string name): name_ { std::move(name) } { }
+			explicit Variable(Symbol name): Expression { Kind::variable }, name_ { name } { }
 			llvm::Value* generate_code() override;
+			double evaluate() override;
+			Folded fold(Arena& arena) override;
 	};
 
 	class Binary: public Expression {
 			char op_;
-			Expression_Ptr left_hand_side_;
-			Expression_Ptr right_hand_side_;
+			Expression* left_hand_side_;
+			Expression* right_hand_side_;
 
 		public:
-			Binary(
-				char op, Expression_Ptr left_hand_side, Expression_Ptr right_hand_side
-			):
-				op_ { op }, left_hand_side_ { std::move(left_hand_side) },
-				right_hand_side_ { std::move(right_hand_side) }
+			Binary(char op, Expression* left_hand_side, Expression* right_hand_side):
+				Expression { Kind::binary }, op_ { op }, left_hand_side_ { left_hand_side },
+				right_hand_side_ { right_hand_side }
 			{ }
+			static bool classof(const Expression* e) { return e->kind() == Kind::binary; }
+
+			[[nodiscard]] Expression* left_hand_side() const { return left_hand_side_; }
+			[[nodiscard]] Expression* right_hand_side() const { return right_hand_side_; }
 			llvm::Value* generate_code() override;
+			llvm::Value* generate_code(llvm::Value* left, llvm::Value* right);
+			double evaluate() override;
+			double evaluate(double left, double right);
+			Folded fold(Arena& arena) override;
+			Folded fold(Folded left, Folded right, Arena& arena);
 	};
 
 	class Unary: public Expression {
 			char op_;
-			Expression_Ptr right_hand_side_;
+			Expression* right_hand_side_;
 
 		public:
-			Unary(char op, Expression_Ptr right_hand_side):
-				op_ { op }, right_hand_side_ { std::move(right_hand_side) }
+			Unary(char op, Expression* right_hand_side):
+				Expression { Kind::unary }, op_ { op }, right_hand_side_ { right_hand_side }
 			{ }
-			llvm::Value* generate_code() override { return nullptr; }
+			static bool classof(const Expression* e) { return e->kind() == Kind::unary; }
+
+			[[nodiscard]] Expression* right_hand_side() const { return right_hand_side_; }
+			llvm::Value* generate_code() override;
+			llvm::Value* generate_code(llvm::Value* operand);
+			double evaluate() override;
+			double evaluate(double operand);
+			Folded fold(Arena& arena) override;
+			Folded fold(Folded operand, Arena& arena);
 	};
 
 	class Call: public Expression {
-			std::string callee_;
-			std::vector<Expression_Ptr> args_;
+			Symbol callee_;
+			llvm::ArrayRef<Expression*> args_;
 
 		public:
-			Call(std::string callee, std::vector<Expression_Ptr> args):
-				callee_ { std::move(callee) }, args_ { std::move(args) }
+			Call(Symbol callee, llvm::ArrayRef<Expression*> args):
+				Expression { Kind::call }, callee_ { callee }, args_ { args }
 			{ }
 			llvm::Value* generate_code() override;
+			double evaluate() override;
+			Folded fold(Arena& arena) override;
 	};
 
 	class If: public Expression {
-			Expression_Ptr condition_;
-			Expression_Ptr then_;
-			Expression_Ptr else_;
+			Expression* condition_;
+			Expression* then_;
+			Expression* else_;
 
 		public:
-			If(Expression_Ptr condition, Expression_Ptr then, Expression_Ptr els):
-				condition_ { std::move(condition) }, then_ { std::move(then) },
-				else_ { std::move(els) }
+			If(Expression* condition, Expression* then, Expression* els):
+				Expression { Kind::if_then_else }, condition_ { condition }, then_ { then },
+				else_ { els }
 			{ }
 
+			static bool classof(const Expression* e) { return e->kind() == Kind::if_then_else; }
+
 			llvm::Value * generate_code() override;
+			bool generate_returns();
+			double evaluate() override;
+			Folded fold(Arena& arena) override;
 	};
 
 	class For: public Expression {
-			std::string var_name_;
-			Expression_Ptr start_;
-			Expression_Ptr end_;
-			Expression_Ptr step_;
-			Expression_Ptr body_;
+			Symbol var_name_;
+			Expression* start_;
+			Expression* end_;
+			Expression* step_;
+			Expression* body_;
 
 		public:
 			For(
-				std::string  var_name, Expression_Ptr start, Expression_Ptr end,
-				Expression_Ptr step, Expression_Ptr body
+				Symbol var_name, Expression* start, Expression* end,
+				Expression* step, Expression* body
 			):
-				var_name_ { std::move(var_name) }, start_ { std::move(start) },
-				end_ { std::move(end) }, step_ { std::move(step) }, body_ { std::move(body) }
+				Expression { Kind::for_loop }, var_name_ { var_name }, start_ { start },
+				end_ { end }, step_ { step }, body_ { body }
 			{ }
 
 			llvm::Value * generate_code() override;
+			double evaluate() override;
+			Folded fold(Arena& arena) override;
 	};
 
 	class Prototype {
-			std::string name_;
-			std::vector<std::string> args_;
+			Symbol name_;
+			std::vector<Symbol> args_;
 			bool is_operator_;
 			unsigned precedence_;
+			bool internal_ { false };
 
 		public:
 			Prototype(
-				std::string name, std::vector<std::string> args,
+				Symbol name, std::vector<Symbol> args,
 				bool is_operator = false, unsigned precedence = 0
 			):
-				name_ { std::move(name) }, args_ { std::move(args) },
+				name_ { name }, args_ { std::move(args) },
 				is_operator_ { is_operator }, precedence_ { precedence }
 			{ }
 
-			[[nodiscard]] const std::string& name() const { return name_; }
+			[[nodiscard]] Symbol symbol() const { return name_; }
+			[[nodiscard]] std::string_view name() const { return symbol_name(name_); }
+			[[nodiscard]] const std::vector<Symbol>& args() const { return args_; }
 			bool is_unary_op() const { return is_operator_ && args_.size() == 1; }
 			bool is_binary_op() const { return is_operator_ && args_.size() == 2; }
 			char operator_name() const {
 				assert(is_unary_op() || is_binary_op());
-				return name_[name_.size() - 1];
+				return name().back();
 			}
 			unsigned binary_precedence() const { return precedence_; }
+			// Internal functions are only called from Kaleidoscope code and use fastcc.
+			[[nodiscard]] bool is_internal() const { return internal_; }
+			void set_internal(bool internal) { internal_ = internal; }
 
 			llvm::Function* generate_code();
 	};
@@ -135,21 +193,44 @@ namespace ast {
 
 	Prototype_Ptr log_prototype_error(const char* message);
 
+	struct Evaluation {
+		enum class Status { done, failed, out_of_fuel, too_deep };
+		Status status;
+		double value;
+	};
+
 	class Function {
 			Prototype_Ptr prototype_;
-			Expression_Ptr body_;
+			Prototype* declared_ { nullptr };
+			Prototype_Ptr replaced_;
+			Expression* body_;
+			Arena arena_;
+			bool retained_ { false };
 
 		public:
-			Function(Prototype_Ptr prototype, Expression_Ptr body):
-				prototype_ { std::move(prototype) }, body_ { std::move(body) }
+			Function(Prototype_Ptr prototype, Expression* body, Arena arena):
+				prototype_ { std::move(prototype) }, body_ { body },
+				arena_ { std::move(arena) }
 			{ }
 
+			[[nodiscard]] const Prototype& prototype() const {
+				return prototype_ ? *prototype_ : *declared_;
+			}
+			[[nodiscard]] Expression* body() const { return body_; }
+
+			void declare();
+			void undeclare();
+			void retain() { retained_ = true; }
 			llvm::Function* generate_code();
+			Evaluation evaluate(std::uint64_t fuel);
 	};
 
 	using Function_Ptr = std::unique_ptr<Function>;
 
-	Expression_Ptr parse_expression();
+	void define_function(Function_Ptr function);
+	Function* defined_function(Symbol name);
+
+	Expression* parse_expression(Arena& arena);
 
-	extern std::map<std::string, Prototype_Ptr> FunctionProtos;
+	Prototype_Ptr add_prototype(Prototype_Ptr prototype);
 };
\ No newline at end of file
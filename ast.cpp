@@ -1,48 +1,60 @@
 #include "ast.h"
 #include "tok.h"
 #include "ast-expression.h"
+#include "stats.h"
+
+#include <llvm/Support/DynamicLibrary.h>
+#include <string>
 
 namespace ast {
 	Prototype_Ptr parse_prototype() {
-		std::string fn_name;
+		Symbol fn_name;
 		unsigned kind = 0;
 		unsigned binary_precedence = 30;
 
-		switch (cur_tok) {
+		switch (tokens.kind()) {
 			case tok_identifier:
-				fn_name = identifier;
+				fn_name = tokens.symbol();
 				kind = 0;
-				next_tok();
+				tokens.next();
+				break;
+			case tok_unary:
+				tokens.next();
+				if (!isascii(tokens.kind())) {
+					return log_prototype_error("expected unary operator");
+				}
+				fn_name = intern(std::string("unary") + static_cast<char>(tokens.kind()));
+				kind = 1;
+				tokens.next();
 				break;
 			case tok_binary:
-				next_tok();
-				if (!isascii(cur_tok)) {
+				tokens.next();
+				if (!isascii(tokens.kind())) {
 					return log_prototype_error("expected binary operator");
 				}
-				fn_name = "binary";
-				fn_name += static_cast<char>(cur_tok);
+				fn_name = intern(std::string("binary") + static_cast<char>(tokens.kind()));
 				kind = 2;
-				next_tok();
+				tokens.next();
 
-				if (cur_tok == tok_number) {
-					if (value < 1 || value > 100) {
+				if (tokens.kind() == tok_number) {
+					if (tokens.value() < 1 || tokens.value() > 100) {
 						return log_prototype_error("invalid precedence: must be 1..100");
 					}
-					binary_precedence = static_cast<unsigned>(value);
-					next_tok();
+					binary_precedence = static_cast<unsigned>(tokens.value());
+					tokens.next();
 				}
 				break;
 			default:
 				return log_prototype_error("expected function name in prototype");
 		}
 
-		if (cur_tok != '(') { return log_prototype_error("expected '(' in prototype"); }
-		std::vector<std::string> arg_names;
-		while (next_tok() == tok_identifier) {
-			arg_names.push_back(identifier);
+		if (tokens.kind() != '(') { return log_prototype_error("expected '(' in prototype"); }
+		std::vector<Symbol> arg_names;
+		while (tokens.next() == tok_identifier) {
+			arg_names.push_back(tokens.symbol());
 		}
-		if (cur_tok != ')') { return log_prototype_error("expected ')' in prototype"); }
-		next_tok();
+		if (tokens.kind() != ')') { return log_prototype_error("expected ')' in prototype"); }
+		tokens.next();
 		if (kind && arg_names.size() != kind) {
 			return log_prototype_error("invalid number of arguments for operator");
 		}
@@ -52,24 +64,35 @@ namespace ast {
 	}
 
 	Function_Ptr parse_definition() {
-		next_tok();
+		Phase_Timer timer { Phase::parse };
+		tokens.next();
 		auto proto { parse_prototype() };
 		if (! proto) { return nullptr; }
-		if (auto expr { parse_expression() }) {
-			return std::make_unique<Function>(std::move(proto), std::move(expr));
+		proto->set_internal(true);
+		Arena arena;
+		if (auto expr { parse_expression(arena) }) {
+			return std::make_unique<Function>(std::move(proto), expr, std::move(arena));
 		}
 		return nullptr;
 	}
 
 	Prototype_Ptr parse_extern() {
-		next_tok();
-		return parse_prototype();
+		Phase_Timer timer { Phase::parse };
+		tokens.next();
+		auto proto { parse_prototype() };
+		// Externs the process can't resolve must be defined later in Kaleidoscope.
+		if (proto && ! llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(std::string { proto->name() })) {
+			proto->set_internal(true);
+		}
+		return proto;
 	}
 
-	Function_Ptr parse_top_level_expr() {
-		if (auto expr { parse_expression() }) {
-			auto proto { std::make_unique<Prototype>("__anon_expr", std::vector<std::string>()) };
-			return std::make_unique<Function>(std::move(proto), std::move(expr));
+	Function_Ptr parse_top_level_expr(std::string_view name) {
+		Phase_Timer timer { Phase::parse };
+		Arena arena;
+		if (auto expr { parse_expression(arena) }) {
+			auto proto { std::make_unique<Prototype>(intern(name), std::vector<Symbol>()) };
+			return std::make_unique<Function>(std::move(proto), expr, std::move(arena));
 		}
 		return nullptr;
 	}
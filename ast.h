@@ -6,5 +6,5 @@ namespace ast {
 	Prototype_Ptr parse_prototype();
 	Function_Ptr parse_definition();
 	Prototype_Ptr parse_extern();
-	Function_Ptr parse_top_level_expr();
+	Function_Ptr parse_top_level_expr(std::string_view name = "__anon_expr");
 }
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "../code.h"
+#include "../source.h"
+#include "../tok.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Support/TargetSelect.h>
+#include <string>
+#include <unistd.h>
+
+// Helpers shared by the benchmarks; each bench/*.cpp builds into its own program.
+namespace bench {
+	using Clock = std::chrono::steady_clock;
+
+	inline llvm::ExitOnError ExitOnErr;
+
+	// Results are stored here so the compiler can't drop the work that produced them.
+	inline volatile double sink;
+
+	inline double seconds_since(Clock::time_point start) {
+		return std::chrono::duration<double> { Clock::now() - start }.count();
+	}
+
+	// Writes text to a new temporary file and returns its path; the caller unlinks it.
+	inline std::string write_temporary(const std::string& text) {
+		char path[] { "/tmp/kaleidoscope-bench-XXXXXX" };
+		int fd { mkstemp(path) };
+		bool ok { fd >= 0 && write(fd, text.data(), text.size()) == static_cast<ssize_t>(text.size()) };
+		if (fd >= 0) { close(fd); }
+		if (! ok) {
+			std::cerr << "Error: can't write " << path << "\n";
+			std::exit(EXIT_FAILURE);
+		}
+		return path;
+	}
+
+	// Makes text the token source and reads its first token. The source is
+	// mapped from a file, so text goes through a temporary one.
+	inline void load_source(const std::string& text) {
+		auto path { write_temporary(text) };
+		auto opened { source.open(path.c_str()) };
+		unlink(path.c_str());
+		if (! opened) {
+			std::cerr << "Error: can't open " << path << "\n";
+			std::exit(EXIT_FAILURE);
+		}
+		tokens.reset();
+		tokens.kind();
+	}
+
+	// Replaces the_jit with a new one and starts a fresh module for it.
+	inline void start_jit(llvm::StringRef cpu = "", unsigned threads = 0) {
+		static const bool initialized { [] {
+			llvm::InitializeNativeTarget();
+			llvm::InitializeNativeTargetAsmPrinter();
+			llvm::InitializeNativeTargetAsmParser();
+			return true;
+		}() };
+		(void) initialized;
+		the_jit = ExitOnErr(llvm::orc::KaleidoscopeJIT::Create(cpu, threads));
+		init_module_and_fpm();
+	}
+
+	// Releases the module, builder and JIT before static destruction.
+	inline void stop_jit() {
+		the_module.reset();
+		builder.reset();
+		the_jit.reset();
+	}
+
+	// Hands the current module to the_jit and starts a new one.
+	inline void add_current_module(llvm::orc::ResourceTrackerSP tracker = nullptr) {
+		ExitOnErr(the_jit->addModule(
+			llvm::orc::ThreadSafeModule(std::move(the_module), std::move(the_context)), std::move(tracker)
+		));
+		init_module_and_fpm();
+	}
+}
@@ -0,0 +1,47 @@
+#include "../ast.h"
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+static constexpr unsigned definitions { 1000 };
+
+static std::string library() {
+	std::string text;
+	for (unsigned i { 0 }; i < definitions; ++i) {
+		auto n { std::to_string(i) };
+		text += "def f" + n + "(a b) if a < b then (a + " + n + ") * (b - 1) else ";
+		text += "(for i = 1, i < b in a * i + " + n + ") + a * b * " + n + ";\n";
+	}
+	return text;
+}
+
+static double run(unsigned threads, const std::string& text) {
+	bench::start_jit("", threads);
+	bench::load_source(text);
+	auto start { bench::Clock::now() };
+	for (; tokens.kind() != tok_eof; tokens.next()) {
+		auto function { ast::parse_definition() };
+		if (! function || ! function->generate_code()) {
+			std::cerr << "Error: definition failed to compile\n";
+			std::exit(EXIT_FAILURE);
+		}
+		bench::add_current_module();
+	}
+	for (unsigned i { 0 }; i < definitions; ++i) { bench::ExitOnErr(the_jit->lookup("f" + std::to_string(i))); }
+	auto elapsed { bench::seconds_since(start) };
+	bench::stop_jit();
+	return elapsed;
+}
+
+int main() {
+	auto text { library() };
+	double serial { run(0, text) };
+	std::printf("-j0 %4u definitions: %8.2f ms\n", definitions, serial * 1e3);
+	for (unsigned threads { 1 }; threads <= 8; threads *= 2) {
+		double elapsed { run(threads, text) };
+		std::printf("-j%u %4u definitions: %8.2f ms, %5.2fx\n", threads, definitions, elapsed * 1e3, serial / elapsed);
+	}
+}
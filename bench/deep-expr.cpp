@@ -0,0 +1,51 @@
+#include "../ast.h"
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+static std::string chain(unsigned terms) {
+	std::string text { "def chain(a b) a" };
+	for (unsigned i { 1 }; i < terms; ++i) {
+		text += i % 3 ? " + b * " : " - a * ";
+		text += std::to_string(i % 7 + 1);
+	}
+	return text + ";\n";
+}
+
+static std::string nested(unsigned terms) {
+	std::string text { "def nested(a b) " };
+	for (unsigned i { 1 }; i < terms; ++i) { text += i % 2 ? "(a + " : "(b * "; }
+	text += "a";
+	text.append(terms - 1, ')');
+	return text + ";\n";
+}
+
+template<typename Generate> static void run(const char* name, Generate generate) {
+	for (unsigned terms { 1000 }; terms <= 128000; terms *= 2) {
+		bench::load_source(generate(terms));
+		init_module_and_fpm();
+		auto start { bench::Clock::now() };
+		auto function { ast::parse_definition() };
+		auto parsed { bench::Clock::now() };
+		auto code { function ? function->generate_code() : nullptr };
+		auto generated { bench::Clock::now() };
+		if (! code) {
+			std::cerr << "Error: " << name << " failed at " << terms << " terms\n";
+			std::exit(EXIT_FAILURE);
+		}
+		std::chrono::duration<double> parse { parsed - start };
+		std::chrono::duration<double> codegen { generated - parsed };
+		std::printf("%-8s %7u terms: parse %8.2f ms, codegen %8.2f ms, %6.1f ns/term\n",
+			name, terms, parse.count() * 1e3, codegen.count() * 1e3,
+			(parse + codegen).count() * 1e9 / terms
+		);
+	}
+}
+
+int main() {
+	run("chain", chain);
+	run("nested", nested);
+}
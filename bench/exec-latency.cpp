@@ -0,0 +1,58 @@
+#include "../ast.h"
+#include "bench.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+static constexpr unsigned repeats { 200 };
+
+static void define(const std::string& text) {
+	bench::load_source(text);
+	auto function { ast::parse_definition() };
+	function->retain();
+	if (! function->generate_code()) {
+		std::cerr << "Error: definition failed to compile\n";
+		std::exit(EXIT_FAILURE);
+	}
+	bench::add_current_module();
+	ast::define_function(std::move(function));
+}
+
+static double jit(ast::Function& expression) {
+	expression.generate_code();
+	auto rt { the_jit->getMainJITDylib().createResourceTracker() };
+	bench::add_current_module(rt);
+	auto symbol { bench::ExitOnErr(the_jit->lookup("__anon_expr")) };
+	auto result { reinterpret_cast<double (*)()>(symbol.getAddress())() };
+	bench::ExitOnErr(rt->remove());
+	return result;
+}
+
+static double interpret(ast::Function& expression) { return expression.evaluate(UINT64_MAX).value; }
+
+template<typename Run> static double measure(const std::string& expression, Run run) {
+	std::string text;
+	for (unsigned i { 0 }; i < repeats; ++i) { text += expression + ";\n"; }
+	bench::load_source(text);
+	auto start { bench::Clock::now() };
+	for (; tokens.kind() != tok_eof; tokens.next()) {
+		auto function { ast::parse_top_level_expr() };
+		bench::sink = run(*function);
+	}
+	return bench::seconds_since(start) * 1e6 / repeats;
+}
+
+int main() {
+	bench::start_jit();
+	define("def fib(x) if x < 3 then 1 else fib(x - 1) + fib(x - 2);");
+	define("def sum(n) for i = 1, i < n in i * 2;");
+	for (auto expression : { "1 + 2 * 3", "fib(10)", "sum(100)", "fib(20)", "fib(25)" }) {
+		auto interpreted { measure(expression, interpret) };
+		auto compiled { measure(expression, jit) };
+		std::printf("%-10s interp %10.1f us, jit %10.1f us\n", expression, interpreted, compiled);
+	}
+	bench::stop_jit();
+}
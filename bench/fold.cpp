@@ -0,0 +1,136 @@
+#include "../ast.h"
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <llvm/Support/CommandLine.h>
+#include <random>
+#include <string>
+
+using bench::Clock;
+using bench::seconds_since;
+
+static constexpr unsigned function_count { 2000 };
+static constexpr unsigned calls { 1000 };
+
+static std::string digit(std::mt19937& random) { return std::to_string(random() % 10); }
+
+// A small expression over x, y and digits; about half of its leaves are constants.
+static std::string mixed(std::mt19937& random, unsigned depth) {
+	static constexpr const char* ops[] { " + ", " - ", " * ", " < " };
+	if (depth == 0) {
+		switch (random() % 4) {
+			case 0: return "x";
+			case 1: return "y";
+			default: return digit(random);
+		}
+	}
+	return "(" + mixed(random, depth - 1) + ops[random() % 4] + mixed(random, depth - 1) + ")";
+}
+
+// Every function has a constant condition, a run of constant terms, identities
+// (x * 1, y - 0) and a dead branch holding a loop that never runs.
+static std::string constant_heavy() {
+	std::mt19937 random { 42 };
+	std::string text;
+	std::string run { "def run(n) for i = 0, i < n in 0" };
+	for (unsigned i { 0 }; i < function_count; ++i) {
+		auto n { std::to_string(i) };
+		text += "def f" + n + "(x y) if (1 < 2) then (x * 1";
+		for (unsigned term { 0 }; term < 6; ++term) {
+			text += " + (" + digit(random) + " * " + digit(random) + " - " + digit(random) + ")";
+		}
+		text += ") * (y - 0) + " + mixed(random, 3) + " else x + (for i = 1, 0 in i * 2);\n";
+		run += " + f" + n + "(i, " + std::to_string(i % 7) + ")";
+	}
+	return text + run + ";\n";
+}
+
+struct Fold_Check {
+	const char* definition;
+	bool compiles;
+};
+
+// Folding must not change which programs compile: a dead branch still has to be valid.
+static constexpr Fold_Check fold_checks[] {
+	{ "def livethen(x) if 1 then x else 2;", true },
+	{ "def deadvariable(x) if 1 then x else y;", false },
+	{ "def deadcall(x) if 0 then nosuch(x) else x;", false },
+};
+
+struct Timings {
+	double codegen, optimize, jit_link, execute;
+	std::size_t instructions;
+};
+
+static void use_level(const char* level) {
+	llvm::cl::getRegisteredOptions().lookup("O")->addOccurrence(0, "O", level);
+	// The pass managers are rebuilt when the target changes. start_jit creates
+	// the new JIT before it drops the old one, so their targets never share an address.
+	bench::start_jit();
+}
+
+static bool check_folding(const char* level) {
+	auto passed { true };
+	for (const auto& check : fold_checks) {
+		bench::load_source(check.definition);
+		auto function { ast::parse_definition() };
+		auto compiles { function && function->generate_code() };
+		if (compiles != check.compiles) {
+			std::cerr << "Error: at -O" << level << " '" << check.definition << "' "
+				<< (compiles ? "compiled" : "failed to compile") << "\n";
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+static Timings run(const std::string& text, const char* level) {
+	Timings timings { };
+	bench::load_source(text);
+	for (; tokens.kind() == tok_def; tokens.next()) {
+		auto function { ast::parse_definition() };
+		auto start { Clock::now() };
+		auto ir { function ? function->generate_code() : nullptr };
+		timings.codegen += seconds_since(start);
+		if (! ir) {
+			std::cerr << "Error: workload failed to compile at -O" << level << "\n";
+			std::exit(EXIT_FAILURE);
+		}
+		timings.instructions += ir->getInstructionCount();
+		start = Clock::now();
+		optimize_function(*ir);
+		timings.optimize += seconds_since(start);
+	}
+	bench::load_source("run(" + std::to_string(calls) + ");");
+	ast::parse_top_level_expr()->generate_code();
+	auto start { Clock::now() };
+	bench::add_current_module();
+	auto symbol { bench::ExitOnErr(the_jit->lookup("__anon_expr")) };
+	timings.jit_link = seconds_since(start);
+
+	start = Clock::now();
+	bench::sink = reinterpret_cast<double (*)()>(symbol.getAddress())();
+	timings.execute = seconds_since(start);
+	return timings;
+}
+
+int main() {
+	optimize_each_function = false;
+
+	auto text { constant_heavy() };
+	auto passed { true };
+	std::printf("%u constant-heavy functions, run(%u)\n", function_count, calls);
+	for (auto level : { "0", "1" }) {
+		use_level(level);
+		passed = check_folding(level) && passed;
+		auto timings { run(text, level) };
+		std::printf("-O%s  codegen %8.2f ms, optimize %8.2f ms, jit %8.2f ms, execute %8.2f ms, %7zu instructions\n",
+			level, timings.codegen * 1e3, timings.optimize * 1e3, timings.jit_link * 1e3,
+			timings.execute * 1e3, timings.instructions
+		);
+	}
+	bench::stop_jit();
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
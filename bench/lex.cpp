@@ -0,0 +1,72 @@
+#include "../scan.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+static std::string generate(std::size_t size) {
+	std::string text;
+	text.reserve(size + 256);
+	for (unsigned i { 0 }; text.size() < size; ++i) {
+		text += "# generated helper number " + std::to_string(i) + " with a fairly long comment line\n";
+		text += "def helper" + std::to_string(i) + "(alpha beta gamma)\n";
+		text += "    if alpha < beta then\n        alpha * 2.5 + gamma - 17\n";
+		text += "    else\n        helper" + std::to_string(i / 2) + "(beta, gamma, alpha + 0.125);\n\n";
+	}
+	return text;
+}
+
+template<typename Fn> static double best_seconds(Fn fn, int runs = 5) {
+	double best { 1e30 };
+	for (int i { 0 }; i < runs; ++i) {
+		auto start { bench::Clock::now() };
+		fn();
+		best = std::min(best, bench::seconds_since(start));
+	}
+	return best;
+}
+
+static void report(const char* name, std::size_t bytes, double seconds) {
+	std::printf("%-28s %10.1f MB/s\n", name, bytes / seconds / 1e6);
+}
+
+template<typename Skip> static void bench_skip(
+	const char* name, const std::string& text, Skip skip
+) {
+	const char* volatile sink;
+	auto seconds { best_seconds([&] {
+		auto end { text.data() + text.size() };
+		for (auto p { text.data() }; p < end; ++p) { p = skip(p, end); sink = p; }
+	}) };
+	report(name, text.size(), seconds);
+	(void) sink;
+}
+
+int main(int argc, char* argv[]) {
+	std::size_t size { argc > 1 ? std::strtoul(argv[1], nullptr, 10) << 20 : 32u << 20 };
+	auto text { generate(size) };
+	bench::load_source(text);
+
+	std::size_t count { 0 };
+	auto seconds { best_seconds([&] {
+		tokens.reset();
+		tokens.kind();
+		count = tokens.size();
+	}) };
+	std::printf("%zu bytes, %zu tokens\n", text.size(), count);
+	report("tokenize", text.size(), seconds);
+
+	std::string spaces(size, ' ');
+	std::string comment(size, 'c');
+	std::string alnum(size, 'a');
+	for (std::size_t i { 61 }; i < size; i += 62) { spaces[i] = comment[i] = alnum[i] = ';'; }
+
+	bench_skip("scalar skip_space", spaces, scan::scalar::skip_space);
+	bench_skip("skip_space", spaces, scan::skip_space);
+	bench_skip("scalar skip_comment", comment, scan::scalar::skip_comment);
+	bench_skip("skip_comment", comment, scan::skip_comment);
+	bench_skip("scalar skip_alnum", alnum, scan::scalar::skip_alnum);
+	bench_skip("skip_alnum", alnum, scan::skip_alnum);
+}
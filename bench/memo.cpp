@@ -0,0 +1,69 @@
+#include "../ast.h"
+#include "../memo.h"
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+struct Workload {
+	const char* name;
+	const char* definitions;
+	const char* expression;
+};
+
+// Each workload names its functions with a '$' placeholder so both runs share one JIT.
+static constexpr Workload workloads[] {
+	{ "fib(40)", "def fib$(x) if x < 3 then 1 else fib$(x - 1) + fib$(x - 2);", "fib$(40)" },
+	{ "binom(26, 13)",
+		"def binom$(n k) if k < 1 then 1 else if n < k + 1 then 1 else binom$(n - 1, k - 1) + binom$(n - 1, k);",
+		"binom$(26, 13)" },
+	{ "sweep(200000)",
+		"def pm$(x) if x < 0 then 0 else pm$(0 - 1) + x;\n"
+		"def sweep$(n) for i = 1, i < n in pm$(i);",
+		"sweep$(200000)" },
+};
+
+static std::string instantiate(std::string text, const char* suffix) {
+	for (auto at { text.find('$') }; at != std::string::npos; at = text.find('$', at)) {
+		text.replace(at, 1, suffix);
+	}
+	return text;
+}
+
+static double run(const Workload& workload, const char* suffix) {
+	bench::load_source(instantiate(workload.definitions, suffix));
+	for (; tokens.kind() != tok_eof; tokens.next()) {
+		auto function { ast::parse_definition() };
+		if (! function || ! function->generate_code()) {
+			std::cerr << "Error: " << workload.name << " failed to compile\n";
+			std::exit(EXIT_FAILURE);
+		}
+		bench::add_current_module();
+	}
+	bench::load_source(instantiate(workload.expression, suffix) + ";");
+	auto expression { ast::parse_top_level_expr() };
+	expression->generate_code();
+	auto rt { the_jit->getMainJITDylib().createResourceTracker() };
+	bench::add_current_module(rt);
+	auto symbol { bench::ExitOnErr(the_jit->lookup("__anon_expr")) };
+	auto start { bench::Clock::now() };
+	bench::sink = reinterpret_cast<double (*)()>(symbol.getAddress())();
+	auto elapsed { bench::seconds_since(start) };
+	bench::ExitOnErr(rt->remove());
+	return elapsed * 1e3;
+}
+
+int main() {
+	bench::start_jit();
+	for (const auto& workload : workloads) {
+		enable_memoization(0);
+		auto plain { run(workload, "") };
+		enable_memoization(4096);
+		auto memoized { run(workload, "memo") };
+		std::printf("%-14s plain %10.2f ms, memo %10.3f ms (%.1fx)\n", workload.name, plain, memoized, plain / memoized);
+	}
+	print_memo_stats(std::cout);
+	bench::stop_jit();
+}
@@ -0,0 +1,57 @@
+#include "../ast.h"
+#include "bench.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+static std::size_t allocations { 0 };
+
+void* operator new(std::size_t size) {
+	++allocations;
+	if (auto p { std::malloc(size ? size : 1) }) { return p; }
+	std::abort();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+static std::string generate(unsigned functions) {
+	std::string text;
+	for (unsigned i { 0 }; i < functions; ++i) {
+		auto name { "f" + std::to_string(i) };
+		text += "def " + name + "(a b c)\n";
+		text += "  if a < b then\n    (a + b) * (c - 1) + " + name + "(a - 1, b, c * 2)\n";
+		text += "  else for i = 1, i < c, 0.5 in\n    a * b + c * i - (a - b) * 3;\n";
+		text += name + "(1, 2, 3) + " + name + "(4, 5, 6) * 7;\n";
+	}
+	return text;
+}
+
+int main(int argc, char* argv[]) {
+	unsigned functions { argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 20000u };
+	auto text { generate(functions) };
+	bench::load_source(text);
+
+	auto before { allocations };
+	auto start { bench::Clock::now() };
+	std::size_t items { 0 };
+	for (;;) {
+		switch (tokens.kind()) {
+			case tok_eof: break;
+			case ';': tokens.next(); continue;
+			case tok_def: if (! ast::parse_definition()) { tokens.next(); } ++items; continue;
+			case tok_extern: if (! ast::parse_extern()) { tokens.next(); } ++items; continue;
+			default: if (! ast::parse_top_level_expr()) { tokens.next(); } ++items; continue;
+		}
+		break;
+	}
+	auto took { bench::seconds_since(start) };
+	auto count { allocations - before };
+
+	std::printf("%zu bytes, %zu tokens, %zu items\n", text.size(), tokens.size(), items);
+	std::printf("parse: %.2f ms, %zu allocations (%.1f per item)\n",
+		took * 1e3, count, static_cast<double>(count) / items
+	);
+}
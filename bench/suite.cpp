@@ -0,0 +1,228 @@
+#include "../ast.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <optional>
+#include <spawn.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using bench::Clock;
+using bench::ExitOnErr;
+using bench::seconds_since;
+
+struct Workload {
+	const char* name;
+	std::string text;
+};
+
+struct Phases {
+	double lex, parse, codegen, optimize, jit_link, execute;
+	unsigned items;
+};
+
+static std::string fib() {
+	return "def fib(x) if x < 3 then 1 else fib(x - 1) + fib(x - 2);\nfib(30);\n";
+}
+
+static std::string loops() {
+	return
+		"def kernel(n) for i = 1, i < n in for j = 1, j < n in i * j - (i + j) * 0.5;\n"
+		"def dot(n) for i = 0, i < n in (i * 1.5) * (n - i);\n"
+		"kernel(1000);\ndot(1000000);\n";
+}
+
+static std::string large_program() {
+	std::string text;
+	for (unsigned i { 0 }; i < 500; ++i) {
+		auto n { std::to_string(i) };
+		text += "def f" + n + "(a b c) if a < b then (a + b) * (c - " + n + ") + a * b * c ";
+		text += "else (for i = 1, i < c in a * i + b) + (a - b) * (b - c) * " + n + ";\n";
+	}
+	text += "f1(1, 2, 3) + f250(4, 3, 2) + f499(5, 6, 7);\n";
+	return text;
+}
+
+static std::string small_functions() {
+	std::string text;
+	std::string sum { "0" };
+	for (unsigned i { 0 }; i < 1000; ++i) {
+		auto n { std::to_string(i) };
+		text += "def s" + n + "(x) x + " + n + ";\n";
+		sum += " + s" + n + "(1)";
+	}
+	return text + sum + ";\n";
+}
+
+static std::string deep_expression() {
+	std::string text { "def chain(a b) a" };
+	for (unsigned i { 1 }; i < 5000; ++i) {
+		text += i % 3 ? " + b * " : " - a * ";
+		text += std::to_string(i % 7 + 1);
+	}
+	return text + ";\nchain(1, 2);\n";
+}
+
+static Phases run_phases(const std::string& path) {
+	Phases phases { };
+	source.open(path.c_str());
+
+	auto start { Clock::now() };
+	tokens.reset();
+	while (tokens.kind() != tok_eof) { tokens.next(); }
+	phases.lex = seconds_since(start);
+
+	struct Item {
+		ast::Function_Ptr function;
+		std::string expression;
+	};
+	std::vector<Item> items;
+	unsigned expressions { 0 };
+	start = Clock::now();
+	tokens.reset();
+	for (;;) {
+		auto kind { tokens.kind() };
+		if (kind == tok_eof) { break; }
+		if (kind == ';') { tokens.next(); continue; }
+		Item item;
+		if (kind == tok_def) {
+			item.function = ast::parse_definition();
+		} else {
+			item.expression = "__suite_expr." + std::to_string(expressions++);
+			item.function = ast::parse_top_level_expr(item.expression);
+		}
+		if (! item.function) {
+			std::cerr << "Error: workload failed to parse\n";
+			std::exit(EXIT_FAILURE);
+		}
+		items.push_back(std::move(item));
+	}
+	phases.parse = std::max(0.0, seconds_since(start) - phases.lex);
+	phases.items = items.size();
+
+	for (auto& item : items) {
+		start = Clock::now();
+		auto ir { item.function->generate_code() };
+		phases.codegen += seconds_since(start);
+		if (! ir) {
+			std::cerr << "Error: workload failed to compile\n";
+			std::exit(EXIT_FAILURE);
+		}
+		start = Clock::now();
+		optimize_function(*ir);
+		phases.optimize += seconds_since(start);
+
+		start = Clock::now();
+		bench::add_current_module();
+		if (item.expression.empty()) {
+			phases.jit_link += seconds_since(start);
+			continue;
+		}
+		auto symbol { ExitOnErr(the_jit->lookup(item.expression)) };
+		phases.jit_link += seconds_since(start);
+
+		start = Clock::now();
+		reinterpret_cast<double (*)()>(symbol.getAddress())();
+		phases.execute += seconds_since(start);
+	}
+	return phases;
+}
+
+// Runs program on path, passed as its argument or on its stdin, without a shell. A run
+// that fails to start or exits unsuccessfully is reported and has no time.
+static std::optional<double> run_process(const std::string& program, const std::string& path, bool path_on_stdin) {
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	if (path_on_stdin) { posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, path.c_str(), O_RDONLY, 0); }
+	posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+	posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+	std::vector<char*> args { const_cast<char*>(program.c_str()) };
+	if (! path_on_stdin) { args.push_back(const_cast<char*>(path.c_str())); }
+	args.push_back(nullptr);
+
+	auto start { Clock::now() };
+	pid_t pid;
+	auto spawned { posix_spawn(&pid, program.c_str(), &actions, nullptr, args.data(), environ) };
+	posix_spawn_file_actions_destroy(&actions);
+	int status { 0 };
+	if (spawned == 0 && waitpid(pid, &status, 0) < 0) { spawned = errno; }
+	auto elapsed { seconds_since(start) };
+
+	auto command { program + (path_on_stdin ? " < " : " ") + path };
+	if (spawned != 0) {
+		std::cerr << "Error: can't run " << command << ": " << std::strerror(spawned) << "\n";
+		return std::nullopt;
+	}
+	if (WIFSIGNALED(status)) {
+		std::cerr << "Error: " << command << " killed by signal " << WTERMSIG(status) << "\n";
+		return std::nullopt;
+	}
+	if (WEXITSTATUS(status) != 0) {
+		std::cerr << "Error: " << command << " exited with status " << WEXITSTATUS(status) << "\n";
+		return std::nullopt;
+	}
+	return elapsed;
+}
+
+static void print_process_time(const char* name, std::optional<double> seconds) {
+	if (seconds) {
+		std::printf(", \"%s\": %.3f", name, *seconds * 1e3);
+	} else {
+		std::printf(", \"%s\": null", name);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	std::string kaleidoscope { argc > 1 ? argv[1] : "" };
+	std::string toy { argc > 2 ? argv[2] : "" };
+	optimize_each_function = false;
+
+	Workload workloads[] {
+		{ "fib", fib() },
+		{ "loops", loops() },
+		{ "large-program", large_program() },
+		{ "small-functions", small_functions() },
+		{ "deep-expression", deep_expression() },
+	};
+
+	std::printf("{\n  \"unit\": \"ms\",\n  \"workloads\": [");
+	const char* separator { "\n" };
+	auto failed { false };
+	for (auto& workload : workloads) {
+		auto path { bench::write_temporary(workload.text) };
+		bench::start_jit();
+		auto phases { run_phases(path) };
+		bench::stop_jit();
+
+		std::printf("%s    { \"name\": \"%s\", \"items\": %u", separator, workload.name, phases.items);
+		std::printf(
+			", \"lex\": %.3f, \"parse\": %.3f, \"codegen\": %.3f, \"optimize\": %.3f, \"jit_link\": %.3f, \"execute\": %.3f",
+			phases.lex * 1e3, phases.parse * 1e3, phases.codegen * 1e3,
+			phases.optimize * 1e3, phases.jit_link * 1e3, phases.execute * 1e3
+		);
+		if (! kaleidoscope.empty()) {
+			auto seconds { run_process(kaleidoscope, path, false) };
+			failed = failed || ! seconds;
+			print_process_time("kaleidoscope_process", seconds);
+		}
+		if (! toy.empty()) {
+			auto seconds { run_process(toy, path, true) };
+			failed = failed || ! seconds;
+			print_process_time("toy_process", seconds);
+		}
+		std::printf(" }");
+		std::fflush(stdout);
+		separator = ",\n";
+		unlink(path.c_str());
+	}
+	std::printf("\n  ]\n}\n");
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
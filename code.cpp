@@ -1,26 +1,173 @@
 #include "code.h"
+#include "stats.h"
 
+#include <llvm/IR/PassManager.h>
+#include <llvm/Passes/OptimizationLevel.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Passes/StandardInstrumentations.h>
+#include <llvm/Support/CommandLine.h>
 #include <llvm/Transforms/InstCombine/InstCombine.h>
-#include <llvm/Transforms/Scalar.h>
 #include <llvm/Transforms/Scalar/GVN.h>
+#include <llvm/Transforms/Scalar/Reassociate.h>
+#include <llvm/Transforms/Scalar/SimplifyCFG.h>
+#include <optional>
 
 std::unique_ptr<llvm::LLVMContext> the_context;
 std::unique_ptr<llvm::IRBuilder<>> builder;
 std::unique_ptr<llvm::Module> the_module;
-std::unique_ptr<llvm::legacy::FunctionPassManager> the_fpm;
 std::unique_ptr<llvm::orc::KaleidoscopeJIT> the_jit;
+std::unique_ptr<llvm::TargetMachine> the_target;
+unsigned module_generation { 0 };
+bool optimize_each_function { true };
+bool keep_frame_pointers { false };
+bool fast_calls { true };
+
+enum class Opt_Level { O0, O1, O2, O3 };
+
+static llvm::cl::opt<Opt_Level> opt_level(
+	"O", llvm::cl::desc("optimization level (default -O1)"),
+	llvm::cl::values(
+		clEnumValN(Opt_Level::O0, "0", "no optimization"),
+		clEnumValN(Opt_Level::O1, "1", "fast function-level cleanup"),
+		clEnumValN(Opt_Level::O2, "2", "the standard -O2 pipeline"),
+		clEnumValN(Opt_Level::O3, "3", "the standard -O3 pipeline")
+	),
+	llvm::cl::Prefix, llvm::cl::ZeroOrMore, llvm::cl::init(Opt_Level::O1)
+);
+
+static std::unique_ptr<llvm::PassInstrumentationCallbacks> the_pic;
+static std::unique_ptr<llvm::TimePassesHandler> the_pass_timer;
+static std::unique_ptr<llvm::PassBuilder> the_pb;
+static std::unique_ptr<llvm::LoopAnalysisManager> the_lam;
+static std::unique_ptr<llvm::FunctionAnalysisManager> the_fam;
+static std::unique_ptr<llvm::CGSCCAnalysisManager> the_cgam;
+static std::unique_ptr<llvm::ModuleAnalysisManager> the_mam;
+static std::unique_ptr<llvm::FunctionPassManager> the_fpm;
+static std::unique_ptr<llvm::ModulePassManager> the_mpm;
+
+static llvm::OptimizationLevel optimization_level() {
+	switch (opt_level) {
+		case Opt_Level::O0: return llvm::OptimizationLevel::O0;
+		case Opt_Level::O1: return llvm::OptimizationLevel::O1;
+		case Opt_Level::O2: return llvm::OptimizationLevel::O2;
+		case Opt_Level::O3: return llvm::OptimizationLevel::O3;
+	}
+	return llvm::OptimizationLevel::O1;
+}
+
+llvm::CodeGenOpt::Level codegen_optimization_level() {
+	switch (opt_level) {
+		case Opt_Level::O0: return llvm::CodeGenOpt::None;
+		case Opt_Level::O1: return llvm::CodeGenOpt::Less;
+		case Opt_Level::O2: return llvm::CodeGenOpt::Default;
+		case Opt_Level::O3: return llvm::CodeGenOpt::Aggressive;
+	}
+	return llvm::CodeGenOpt::Default;
+}
+
+std::string optimization_flag() { return "-O" + std::to_string(static_cast<int>(opt_level.getValue())); }
+
+bool fold_expressions() { return opt_level != Opt_Level::O0; }
+
+static llvm::FunctionPassManager build_fast_pipeline() {
+	llvm::FunctionPassManager fpm;
+	fpm.addPass(llvm::InstCombinePass());
+	fpm.addPass(llvm::ReassociatePass());
+	fpm.addPass(llvm::GVNPass());
+	fpm.addPass(llvm::SimplifyCFGPass());
+	return fpm;
+}
+
+static llvm::ModulePassManager build_module_pipeline(llvm::PassBuilder& pb) {
+	auto level { optimization_level() };
+	if (level == llvm::OptimizationLevel::O0) { return pb.buildO0DefaultPipeline(level); }
+	if (level == llvm::OptimizationLevel::O1) {
+		llvm::ModulePassManager mpm;
+		mpm.addPass(llvm::createModuleToFunctionPassAdaptor(build_fast_pipeline()));
+		return mpm;
+	}
+	return pb.buildPerModuleDefaultPipeline(level);
+}
+
+static llvm::TargetMachine* target_machine() { return the_jit ? &the_jit->getTargetMachine() : the_target.get(); }
+
+static llvm::TargetMachine* pass_target { nullptr };
+
+static void init_pass_managers() {
+	pass_target = target_machine();
+	the_pb = std::make_unique<llvm::PassBuilder>(
+		pass_target, llvm::PipelineTuningOptions { }, std::nullopt, the_pic.get()
+	);
+	the_lam = std::make_unique<llvm::LoopAnalysisManager>();
+	the_fam = std::make_unique<llvm::FunctionAnalysisManager>();
+	the_cgam = std::make_unique<llvm::CGSCCAnalysisManager>();
+	the_mam = std::make_unique<llvm::ModuleAnalysisManager>();
+	the_pb->registerModuleAnalyses(*the_mam);
+	the_pb->registerCGSCCAnalyses(*the_cgam);
+	the_pb->registerFunctionAnalyses(*the_fam);
+	the_pb->registerLoopAnalyses(*the_lam);
+	the_pb->crossRegisterProxies(*the_lam, *the_fam, *the_cgam, *the_mam);
+
+	auto level { optimization_level() };
+	the_fpm = std::make_unique<llvm::FunctionPassManager>();
+	if (level == llvm::OptimizationLevel::O1) {
+		*the_fpm = build_fast_pipeline();
+	} else if (level != llvm::OptimizationLevel::O0) {
+		*the_fpm = the_pb->buildFunctionSimplificationPipeline(level, llvm::ThinOrFullLTOPhase::None);
+	}
+	the_mpm = std::make_unique<llvm::ModulePassManager>(build_module_pipeline(*the_pb));
+}
 
 void init_module_and_fpm() {
+	++module_generation;
+	if (the_fam && pass_target == target_machine()) {
+		the_lam->clear();
+		the_fam->clear();
+		the_cgam->clear();
+		the_mam->clear();
+	} else { init_pass_managers(); }
+	the_module.reset();
+	builder.reset();
 	the_context = std::make_unique<llvm::LLVMContext>();
 	builder = std::make_unique<llvm::IRBuilder<>>(*the_context);
 	the_module = std::make_unique<llvm::Module>("kaleidoscope", *the_context);
-	/*
-	the_module->setDataLayout(the_jit->getTargetMachine().createDataLayout());
-	 */
-	the_fpm = std::make_unique<llvm::legacy::FunctionPassManager>(the_module.get());
-	the_fpm->add(llvm::createInstructionCombiningPass());
-	the_fpm->add(llvm::createReassociatePass());
-	the_fpm->add(llvm::createGVNPass());
-	the_fpm->add(llvm::createCFGSimplificationPass());
-	the_fpm->doInitialization();
-}
\ No newline at end of file
+	if (auto target { target_machine() }) {
+		the_module->setDataLayout(target->createDataLayout());
+		the_module->setTargetTriple(target->getTargetTriple().str());
+	}
+}
+
+void enable_pass_timing() {
+	the_pic = std::make_unique<llvm::PassInstrumentationCallbacks>();
+	the_pass_timer = std::make_unique<llvm::TimePassesHandler>(true);
+	the_pass_timer->registerCallbacks(*the_pic);
+}
+
+void print_pass_timing() {
+	if (the_pass_timer) { the_pass_timer->print(); }
+}
+
+void optimize_function(llvm::Function& fn) {
+	Phase_Timer timer { Phase::optimize };
+	the_fpm->run(fn, *the_fam);
+	the_fam->clear(fn, fn.getName());
+}
+
+void optimize_module() {
+	Phase_Timer timer { Phase::optimize };
+	the_mpm->run(*the_module, *the_mam);
+}
+
+void optimize_module(llvm::Module& module) {
+	llvm::PassBuilder pb { the_jit ? the_jit->getThreadTargetMachine() : the_target.get() };
+	llvm::LoopAnalysisManager lam;
+	llvm::FunctionAnalysisManager fam;
+	llvm::CGSCCAnalysisManager cgam;
+	llvm::ModuleAnalysisManager mam;
+	pb.registerModuleAnalyses(mam);
+	pb.registerCGSCCAnalyses(cgam);
+	pb.registerFunctionAnalyses(fam);
+	pb.registerLoopAnalyses(lam);
+	pb.crossRegisterProxies(lam, fam, cgam, mam);
+	build_module_pipeline(pb).run(module, mam);
+}
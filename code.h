@@ -2,14 +2,28 @@
 
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
-#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CodeGen.h>
+#include <string>
 
 #include "KaleidoscopeJIT.h"
 
 extern std::unique_ptr<llvm::LLVMContext> the_context;
 extern std::unique_ptr<llvm::IRBuilder<>> builder;
 extern std::unique_ptr<llvm::Module> the_module;
-extern std::unique_ptr<llvm::legacy::FunctionPassManager> the_fpm;
 extern std::unique_ptr<llvm::orc::KaleidoscopeJIT> the_jit;
+extern std::unique_ptr<llvm::TargetMachine> the_target;
+extern unsigned module_generation;
+extern bool optimize_each_function;
+extern bool keep_frame_pointers;
+extern bool fast_calls;
 
 void init_module_and_fpm();
+void enable_pass_timing();
+void print_pass_timing();
+void optimize_function(llvm::Function& fn);
+void optimize_module();
+void optimize_module(llvm::Module& module);
+std::string optimization_flag();
+bool fold_expressions();
+llvm::CodeGenOpt::Level codegen_optimization_level();
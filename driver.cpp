@@ -1,11 +1,27 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
 #include <llvm/ExecutionEngine/JITSymbol.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
 #include <llvm/Support/TargetSelect.h>
 #include <memory>
+#include <string>
+#include <vector>
 
+#include "aot.h"
 #include "ast.h"
 #include "code.h"
+#include "jit-listeners.h"
+#include "memo.h"
+#include "object-cache.h"
+#include "perf-counters.h"
+#include "profiler.h"
+#include "source.h"
+#include "stats.h"
+#include "tier.h"
 #include "tok.h"
 
 
@@ -16,72 +32,416 @@ extern "C" double putchard(double v) {
 	return 0.0;
 }
 
+static llvm::cl::list<std::string> input_files(
+	llvm::cl::Positional, llvm::cl::desc("<input files>")
+);
+
+static llvm::cl::opt<bool> batch(
+	"batch", llvm::cl::desc("compile each input into one module, then run its top-level expressions")
+);
+
+static llvm::cl::opt<std::string> mcpu(
+	"mcpu", llvm::cl::desc("target CPU for generated code ('native' enables all host features)"),
+	llvm::cl::value_desc("cpu-name")
+);
+
+static llvm::cl::opt<bool> lazy(
+	"lazy", llvm::cl::desc("compile each function on its first call instead of when it is defined")
+);
+
+static llvm::cl::opt<unsigned> jobs(
+	"j", llvm::cl::desc("compile on a pool of N threads (0 compiles on the main thread)"),
+	llvm::cl::value_desc("N"), llvm::cl::Prefix, llvm::cl::init(0)
+);
+
+static llvm::cl::opt<std::string> cache_dir(
+	"cache-dir", llvm::cl::desc("reuse object files compiled by earlier runs from this directory"),
+	llvm::cl::value_desc("path")
+);
+
+static llvm::cl::opt<unsigned> cache_size(
+	"cache-size", llvm::cl::desc("evict the least recently used objects beyond this many MiB (default 64)"),
+	llvm::cl::value_desc("MiB"), llvm::cl::init(64)
+);
+
+static llvm::cl::opt<bool> compile(
+	"c", llvm::cl::desc("compile the inputs into one native object file instead of running them")
+);
+
+static llvm::cl::opt<std::string> output(
+	"o", llvm::cl::desc("object file written by -c (default a.o)"),
+	llvm::cl::value_desc("path"), llvm::cl::init("a.o")
+);
+
+static llvm::cl::opt<bool> emit_main(
+	"main", llvm::cl::desc("with -c, also define a main that prints each top-level expression")
+);
+
+enum class Exec_Mode { interp, jit, automatic };
+
+static llvm::cl::opt<Exec_Mode> exec_mode(
+	"exec", llvm::cl::desc("how to run top-level expressions"),
+	llvm::cl::values(
+		clEnumValN(Exec_Mode::interp, "interp", "interpret everything, never compile"),
+		clEnumValN(Exec_Mode::jit, "jit", "compile everything with the JIT (default)"),
+		clEnumValN(Exec_Mode::automatic, "auto", "interpret top-level expressions, compile the long-running ones")
+	),
+	llvm::cl::init(Exec_Mode::jit)
+);
+
+static llvm::cl::opt<bool> tiered(
+	"tiered", llvm::cl::desc("start functions unoptimized and recompile them optimized once they are hot")
+);
+
+static llvm::cl::opt<unsigned> hot_threshold(
+	"hot-threshold", llvm::cl::desc("calls after which --tiered optimizes a function (default 1000)"),
+	llvm::cl::value_desc("calls"), llvm::cl::init(1000)
+);
+
+static llvm::cl::opt<bool> time_phases(
+	"time-phases", llvm::cl::desc("time each phase and top-level item and every LLVM pass; print them on exit")
+);
+
+static llvm::cl::opt<bool> phase_stats(
+	"phase-stats", llvm::cl::desc("print per-phase times and counts on exit (or at a '?;' command)")
+);
+
+static llvm::cl::opt<bool> perf_counters(
+	"perf-counters", llvm::cl::desc("count cycles, instructions, branch and cache misses of each evaluation")
+);
+
+static llvm::cl::opt<bool> perf_jit(
+	"perf-jit", llvm::cl::desc("describe JIT'd code to perf: /tmp/perf-<pid>.map, plus jitdump when LLVM supports it")
+);
+
+static llvm::cl::opt<bool> gdb_jit(
+	"gdb-jit", llvm::cl::desc("register JIT'd objects with gdb's JIT interface")
+);
+
+static llvm::cl::opt<bool> profile(
+	"profile", llvm::cl::desc("sample JIT'd code with SIGPROF and print a profile after each evaluation")
+);
+
+static llvm::cl::opt<unsigned> profile_interval(
+	"profile-interval", llvm::cl::desc("CPU time between --profile samples (default 1000)"),
+	llvm::cl::value_desc("us"), llvm::cl::init(1000)
+);
+
+static llvm::cl::opt<bool> memo(
+	"memo", llvm::cl::desc("cache the results of pure functions in a fixed-size table keyed on their arguments")
+);
+
+static llvm::cl::opt<unsigned> memo_size(
+	"memo-size", llvm::cl::desc("entries in each --memo table, rounded up to a power of two (default 4096)"),
+	llvm::cl::value_desc("entries"), llvm::cl::init(4096)
+);
+
+static constexpr std::uint64_t auto_fuel { 20000 };
+
 static llvm::ExitOnError ExitOnErr;
 
+static Perf_Counters hardware_counters;
+static std::unique_ptr<Sampling_Profiler> sampler;
+static std::unique_ptr<Function_Map_Listener> jit_functions;
+
+static std::vector<std::string> pending_expressions;
+static unsigned anon_expr_count { 0 };
+
+static void add_current_module(llvm::orc::ResourceTrackerSP rt = nullptr) {
+	Phase_Timer timer { Phase::jit_add };
+	auto tsm { llvm::orc::ThreadSafeModule(std::move(the_module), std::move(the_context)) };
+	if (rt) {
+		ExitOnErr(the_jit->addEagerModule(std::move(tsm), rt));
+	} else { ExitOnErr(the_jit->addModule(std::move(tsm))); }
+	init_module_and_fpm();
+}
+
+static double run_expression(llvm::StringRef name) {
+	llvm::orc::ExecutorAddr address;
+	{
+		Phase_Timer timer { Phase::jit_lookup };
+		address = llvm::orc::ExecutorAddr { ExitOnErr(the_jit->lookup(name)).getAddress() };
+	}
+	Phase_Timer timer { Phase::execute };
+	if (sampler) { sampler->start(); }
+	hardware_counters.start();
+	auto result { address.toPtr<double (*)()>()() };
+	hardware_counters.stop();
+	if (sampler) { sampler->stop(); }
+	return result;
+}
+
+static void print_evaluation(double value) {
+	std::cerr << "evaluated to: " << value;
+	if (hardware_counters.available()) {
+		std::cerr << "  [";
+		hardware_counters.print(std::cerr);
+		std::cerr << ']';
+	}
+	std::cerr << '\n';
+	if (sampler && sampler->collected()) { sampler->report(std::cerr, *jit_functions); }
+}
+
+static bool interpreting_expressions() {
+	return exec_mode == Exec_Mode::interp || (exec_mode == Exec_Mode::automatic && ! batch);
+}
+
 static inline void handle_definition() {
 	if (auto ast { parse_definition() }) {
+		if (exec_mode == Exec_Mode::interp) {
+			std::cerr << "parsed a function definition.\n";
+			define_function(std::move(ast));
+			return;
+		}
+		if (batch) { ast->generate_code(); return; }
 		std::cerr << "parsed a function definition.\n";
+		if (tiered) {
+			if (auto error { add_tiered_definition(std::move(ast)) }) {
+				llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "Error: ");
+			}
+			return;
+		}
+		if (interpreting_expressions()) { ast->retain(); }
 		if (auto ir { ast->generate_code() }) {
 			ir->print(llvm::errs());
 			std::cerr << '\n';
-			ExitOnErr(the_jit->addModule(llvm::orc::ThreadSafeModule(std::move(the_module), std::move(the_context))));
-			init_module_and_fpm();
+			add_current_module();
+			if (interpreting_expressions()) { define_function(std::move(ast)); }
 		}
-	} else { next_tok(); }
+	} else { tokens.next(); }
 }
 
 static inline void handle_extern() {
 	if (auto ast { parse_extern() }) {
 		std::cerr << "parsed an extern.\n";
+		if (exec_mode == Exec_Mode::interp) {
+			ast::add_prototype(std::move(ast));
+			return;
+		}
 		if (auto ir { ast->generate_code() }) {
 			ir->print(llvm::errs());
 			std::cerr << '\n';
-			ast::FunctionProtos[ast->name()] = std::move(ast);
+			ast::add_prototype(std::move(ast));
 		}
-	} else { next_tok(); }
+	} else { tokens.next(); }
+}
+
+static void queue_top_level_expr() {
+	auto name { "__anon_expr." + std::to_string(anon_expr_count++) };
+	if (auto ast { parse_top_level_expr(name) }) {
+		if (ast->generate_code()) { pending_expressions.push_back(std::move(name)); }
+	} else { tokens.next(); }
+}
+
+static void run_pending_expressions() {
+	if (! lazy) { optimize_module(); }
+	add_current_module();
+	for (const auto& name : pending_expressions) {
+		print_evaluation(run_expression(name));
+	}
+	pending_expressions.clear();
+}
+
+static bool compile_pending_expressions() {
+	optimize_module();
+	if (emit_main) { add_main(*the_module, pending_expressions); }
+	return emit_object(*the_module, *the_target, output);
+}
+
+static void compile_top_level_expr(Function& ast) {
+	if (auto ir { ast.generate_code() }) {
+		ir->print(llvm::errs());
+		auto rt { the_jit->getMainJITDylib().createResourceTracker() };
+		add_current_module(rt);
+		print_evaluation(run_expression("__anon_expr"));
+		ExitOnErr(rt->remove());
+	}
+}
+
+static bool interpret_top_level_expr(Function& ast) {
+	auto fuel { exec_mode == Exec_Mode::interp ? UINT64_MAX : auto_fuel };
+	Evaluation result;
+	{
+		Phase_Timer timer { Phase::execute };
+		hardware_counters.start();
+		result = ast.evaluate(fuel);
+		hardware_counters.stop();
+	}
+	switch (result.status) {
+		case Evaluation::Status::done:
+			print_evaluation(result.value);
+			return true;
+		case Evaluation::Status::failed: return true;
+		case Evaluation::Status::out_of_fuel: return false;
+		case Evaluation::Status::too_deep:
+			if (exec_mode == Exec_Mode::automatic) { return false; }
+			std::cerr << "Error: call depth limit exceeded\n";
+			return true;
+	}
+	return false;
 }
 
 static void handle_top_level_expr() {
+	if (batch && ! interpreting_expressions()) { queue_top_level_expr(); return; }
 	if (auto ast { parse_top_level_expr() }) {
 		std::cerr << "parsed a top-level expression.\n";
-		if (auto ir { ast->generate_code() }) {
-			ir->print(llvm::errs());
-			auto rt { the_jit->getMainJITDylib().createResourceTracker() };
-			auto tsm { llvm::orc::ThreadSafeModule(std::move(the_module), std::move(the_context)) };
-			ExitOnErr(the_jit->addModule(std::move(tsm), rt));
-			init_module_and_fpm();
-
-			auto expr { ExitOnErr(the_jit->lookup("__anon_expr")) };
-			assert(expr && "function not found");
-			double (*fp)() = reinterpret_cast<double (*)()>(expr.getAddress());
-			double got { fp() };
-			std::cerr << "evaluated to: " << got << '\n';
-			ExitOnErr(rt->remove());
-		}
-	} else { next_tok(); }
+		if (interpreting_expressions() && interpret_top_level_expr(*ast)) { return; }
+		compile_top_level_expr(*ast);
+	} else { tokens.next(); }
+}
+
+template<typename Handle> static void handle_item(std::string_view kind, Handle handle) {
+	if (! collect_stats) { handle(); return; }
+	std::string name { tokens.text(kind == "expr" ? 0 : 1) };
+	begin_item();
+	handle();
+	end_item(kind, name);
 }
 
 static inline void mainloop() {
 	for (;;) {
-		std::cerr << "> ";
-		switch (cur_tok) {
+		if (! batch) { std::cerr << "> "; }
+		switch (tokens.kind()) {
 			case tok_eof: return;
-			case ';': next_tok(); break;
-			case tok_def: handle_definition(); break;
-			case tok_extern: handle_extern(); break;
-			default: handle_top_level_expr(); break;
+			case ';': tokens.next(); break;
+			case '?':
+				if (collect_stats && (tokens.kind(1) == ';' || tokens.kind(1) == tok_eof)) {
+					tokens.next();
+					print_stats(std::cerr, time_phases);
+					break;
+				}
+				handle_item("expr", handle_top_level_expr);
+				break;
+			case tok_def: handle_item("def", handle_definition); break;
+			case tok_extern: handle_item("extern", handle_extern); break;
+			default: handle_item("expr", handle_top_level_expr); break;
 		}
 	}
 }
 
-int main() {
-	std::cerr << "> ";
-	next_tok();
+static inline void run() {
+	tokens.reset();
+	mainloop();
+	if (batch && the_jit) { run_pending_expressions(); }
+}
+
+// A read error ends the input early, so it must not pass for a clean end of file.
+static bool run_source(const char* name) {
+	run();
+	if (! source.error()) { return true; }
+	std::cerr << "Error: can't read " << name << ": " << std::strerror(source.error()) << "\n";
+	return false;
+}
+
+int main(int argc, char* argv[]) {
+	llvm::cl::ParseCommandLineOptions(argc, argv, "Kaleidoscope JIT\n");
+	if (compile) {
+		// Functions in an object file stay callable from C.
+		fast_calls = false;
+		batch = true;
+		exec_mode = Exec_Mode::jit;
+	}
+	if (tiered && (batch || lazy || exec_mode == Exec_Mode::interp)) {
+		std::cerr << "Error: --tiered can't be combined with --batch, -c, --lazy or --exec=interp\n";
+		return EXIT_FAILURE;
+	}
+	if (tiered && hot_threshold == 0) {
+		std::cerr << "Error: --hot-threshold must be at least 1\n";
+		return EXIT_FAILURE;
+	}
+	optimize_each_function = ! batch && ! lazy && ! tiered;
+	collect_stats = phase_stats || time_phases;
+	if (perf_counters && ! hardware_counters.open()) {
+		std::cerr << "Error: performance counters unavailable (" << hardware_counters.error() << ")\n";
+	} else if (perf_counters && hardware_counters.software()) {
+		std::cerr << "warning: hardware counters unavailable (" << hardware_counters.error() << "), using software counters\n";
+	}
+	if (time_phases) { enable_pass_timing(); }
 	llvm::InitializeNativeTarget();
 	llvm::InitializeNativeTargetAsmPrinter();
 	llvm::InitializeNativeTargetAsmParser();
-	the_jit = ExitOnErr(llvm::orc::KaleidoscopeJIT::Create());
+	if (compile && ! (the_target = create_host_target_machine(mcpu))) { return EXIT_FAILURE; }
+	std::unique_ptr<Object_Cache> cache;
+	if (! cache_dir.empty() && ! compile) {
+		if (llvm::sys::fs::create_directories(cache_dir)) {
+			std::cerr << "Error: can't create cache directory " << cache_dir << "\n";
+			return EXIT_FAILURE;
+		}
+		cache = std::make_unique<Object_Cache>(cache_dir, std::uint64_t { cache_size } << 20);
+	}
+	if (! compile && exec_mode != Exec_Mode::interp) { the_jit = ExitOnErr(llvm::orc::KaleidoscopeJIT::Create(mcpu, jobs, cache.get())); }
+	if (cache && the_jit) {
+		// -mcpu=native resolves differently per machine; salt with what it resolved to.
+		const auto& target { the_jit->getTargetMachine() };
+		cache->set_salt(
+			target.getTargetTriple().str() + ' ' + target.getTargetCPU().str() + ' ' +
+			target.getTargetFeatureString().str() + ' ' + optimization_flag()
+		);
+	}
+	std::unique_ptr<Perf_Map_Listener> perf_map;
+	if (perf_jit && the_jit) {
+		perf_map = std::make_unique<Perf_Map_Listener>();
+		if (perf_map->is_open()) {
+			the_jit->addEventListener(*perf_map);
+		} else { std::cerr << "Error: can't write /tmp/perf-<pid>.map\n"; }
+		if (auto jitdump { llvm::JITEventListener::createPerfJITEventListener() }) {
+			the_jit->addEventListener(*jitdump);
+		}
+	}
+	if (profile && the_jit) {
+		sampler = std::make_unique<Sampling_Profiler>(std::max(profile_interval.getValue(), 1U));
+		if (sampler->open()) {
+			jit_functions = std::make_unique<Function_Map_Listener>();
+			the_jit->addEventListener(*jit_functions);
+			keep_frame_pointers = true;
+		} else {
+			std::cerr << "Error: --profile unavailable (" << sampler->error() << ")\n";
+			sampler.reset();
+		}
+	} else if (profile && ! compile) { std::cerr << "Error: --profile only samples JIT'd code, not --exec=interp\n"; }
+	if (gdb_jit && the_jit) { the_jit->addEventListener(*llvm::JITEventListener::createGDBRegistrationListener()); }
+	if (tiered) { ExitOnErr(enable_tiering(hot_threshold)); }
+	if (memo) { enable_memoization(memo_size); }
+	if (lazy && the_jit) {
+		the_jit->setLazy(true);
+		the_jit->setOptimizer([](llvm::Module& module) { optimize_module(module); });
+	}
 	init_module_and_fpm();
-	mainloop();
+	if (! input_files.empty()) {
+		for (const auto& path : input_files) {
+			if (! source.open(path.c_str())) {
+				std::cerr << "Error: can't open " << path << "\n";
+				the_jit.reset();
+				return EXIT_FAILURE;
+			}
+			if (! run_source(path.c_str())) {
+				the_jit.reset();
+				return EXIT_FAILURE;
+			}
+		}
+	} else {
+		source.open_stdin();
+		if (! run_source("stdin")) {
+			the_jit.reset();
+			return EXIT_FAILURE;
+		}
+	}
+	if (compile) { return compile_pending_expressions() ? EXIT_SUCCESS : EXIT_FAILURE; }
 	the_module->print(llvm::errs(), nullptr);
+	if (lazy && the_jit) {
+		std::cerr << "materialized " << the_jit->getMaterializedFunctions()
+			<< " of " << the_jit->getAddedFunctions() << " functions\n";
+	}
+	if (collect_stats) {
+		print_stats(std::cerr, time_phases);
+		print_pass_timing();
+	}
+	if (tiered) {
+		std::cerr << "promoted " << promoted_functions() << " of " << tiered_functions() << " functions\n";
+	}
+	if (memo) { print_memo_stats(std::cerr); }
+	if (cache) {
+		std::cerr << "object cache: " << cache->hits() << " hits, " << cache->misses() << " misses\n";
+	}
+	the_jit.reset();
 }
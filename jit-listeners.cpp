@@ -0,0 +1,80 @@
+#include "jit-listeners.h"
+
+#include <llvm/Object/SymbolSize.h>
+#include <string>
+#include <unistd.h>
+
+template<typename Visit> static void for_each_function(
+	const llvm::object::ObjectFile& object, const llvm::RuntimeDyld::LoadedObjectInfo& info, Visit visit
+) {
+	auto debug_object { info.getObjectForDebug(object) };
+	const auto& loaded { debug_object.getBinary() ? *debug_object.getBinary() : object };
+	for (const auto& [symbol, size] : llvm::object::computeSymbolSizes(loaded)) {
+		auto type { symbol.getType() };
+		if (! type || *type != llvm::object::SymbolRef::ST_Function) {
+			llvm::consumeError(type.takeError());
+			continue;
+		}
+		auto name { symbol.getName() };
+		auto address { symbol.getAddress() };
+		if (! name || ! address) {
+			llvm::consumeError(name.takeError());
+			llvm::consumeError(address.takeError());
+			continue;
+		}
+		visit(*name, *address, size);
+	}
+}
+
+Perf_Map_Listener::Perf_Map_Listener() {
+	auto path { "/tmp/perf-" + std::to_string(getpid()) + ".map" };
+	map_ = std::fopen(path.c_str(), "w");
+}
+
+Perf_Map_Listener::~Perf_Map_Listener() {
+	if (map_) { std::fclose(map_); }
+}
+
+void Perf_Map_Listener::notifyObjectLoaded(
+	ObjectKey, const llvm::object::ObjectFile& object,
+	const llvm::RuntimeDyld::LoadedObjectInfo& info
+) {
+	if (! map_) { return; }
+	std::lock_guard lock { mutex_ };
+	for_each_function(object, info, [&](llvm::StringRef name, std::uint64_t address, std::uint64_t size) {
+		std::fprintf(map_, "%llx %llx %.*s\n",
+			static_cast<unsigned long long>(address), static_cast<unsigned long long>(size),
+			static_cast<int>(name.size()), name.data()
+		);
+	});
+	std::fflush(map_);
+}
+
+void Function_Map_Listener::notifyObjectLoaded(
+	ObjectKey key, const llvm::object::ObjectFile& object,
+	const llvm::RuntimeDyld::LoadedObjectInfo& info
+) {
+	std::lock_guard lock { mutex_ };
+	auto& starts { objects_[key] };
+	for_each_function(object, info, [&](llvm::StringRef name, std::uint64_t address, std::uint64_t size) {
+		if (! size) { return; }
+		functions_[address] = { address + size, name.str() };
+		starts.push_back(address);
+	});
+}
+
+void Function_Map_Listener::notifyFreeingObject(ObjectKey key) {
+	std::lock_guard lock { mutex_ };
+	auto found { objects_.find(key) };
+	if (found == objects_.end()) { return; }
+	for (auto start : found->second) { functions_.erase(start); }
+	objects_.erase(found);
+}
+
+std::string Function_Map_Listener::find(std::uintptr_t address) {
+	std::lock_guard lock { mutex_ };
+	auto after { functions_.upper_bound(address) };
+	if (after == functions_.begin()) { return {}; }
+	const auto& function { std::prev(after)->second };
+	return address < function.end ? function.name : std::string { };
+}
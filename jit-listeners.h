@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Perf_Map_Listener: public llvm::JITEventListener {
+		std::FILE* map_ { nullptr };
+		std::mutex mutex_;
+
+	public:
+		Perf_Map_Listener();
+		Perf_Map_Listener(const Perf_Map_Listener&) = delete;
+		Perf_Map_Listener& operator=(const Perf_Map_Listener&) = delete;
+		~Perf_Map_Listener() override;
+
+		[[nodiscard]] bool is_open() const { return map_ != nullptr; }
+
+		void notifyObjectLoaded(
+			ObjectKey key, const llvm::object::ObjectFile& object,
+			const llvm::RuntimeDyld::LoadedObjectInfo& info
+		) override;
+};
+
+class Function_Map_Listener: public llvm::JITEventListener {
+		struct Function {
+			std::uint64_t end;
+			std::string name;
+		};
+
+		std::map<std::uint64_t, Function> functions_;
+		llvm::DenseMap<ObjectKey, std::vector<std::uint64_t>> objects_;
+		std::mutex mutex_;
+
+	public:
+		void notifyObjectLoaded(
+			ObjectKey key, const llvm::object::ObjectFile& object,
+			const llvm::RuntimeDyld::LoadedObjectInfo& info
+		) override;
+		void notifyFreeingObject(ObjectKey key) override;
+
+		[[nodiscard]] std::string find(std::uintptr_t address);
+};
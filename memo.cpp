@@ -0,0 +1,163 @@
+#include "memo.h"
+
+#include "code.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/MathExtras.h>
+#include <string>
+
+struct Memo_Counters {
+	std::string name;
+	std::uint64_t hits;
+	std::uint64_t misses;
+};
+
+static unsigned table_bits { 0 };
+static llvm::StringSet<> pure_functions;
+static std::deque<Memo_Counters> counters;
+static llvm::StringMap<Memo_Counters*> counters_by_name;
+
+void enable_memoization(unsigned entries) {
+	table_bits = entries ? llvm::Log2_32_Ceil(std::max(entries, 2U)) : 0;
+}
+
+static bool is_pure(const llvm::Function& function) {
+	for (const auto& bb : function) {
+		for (const auto& instruction : bb) {
+			auto call { llvm::dyn_cast<llvm::CallBase>(&instruction) };
+			if (! call) { continue; }
+			auto callee { call->getCalledFunction() };
+			if (! callee) { return false; }
+			if (callee == &function || callee->isIntrinsic()) { continue; }
+			if (! pure_functions.contains(callee->getName())) { return false; }
+		}
+	}
+	return true;
+}
+
+// Straight-line arithmetic is cheaper to recompute than to look up.
+static bool worth_caching(const llvm::Function& function) {
+	llvm::SmallPtrSet<const llvm::BasicBlock*, 16> seen;
+	for (const auto& bb : function) {
+		for (const auto& instruction : bb) {
+			if (llvm::isa<llvm::CallBase>(instruction)) { return true; }
+		}
+		for (auto successor : llvm::successors(&bb)) {
+			if (seen.contains(successor) || successor == &bb) { return true; }
+		}
+		seen.insert(&bb);
+	}
+	return false;
+}
+
+static Memo_Counters* function_counters(const std::string& name) {
+	if (! the_jit) { return nullptr; }
+	auto& slot { counters_by_name[name] };
+	if (slot) { return slot; }
+	auto& entry { counters.emplace_back(Memo_Counters { name, 0, 0 }) };
+	auto define = [&](const std::string& symbol, std::uint64_t& count) {
+		if (auto error { the_jit->defineAbsolute(symbol, llvm::pointerToJITTargetAddress(&count)) }) {
+			llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "Error: ");
+			return false;
+		}
+		return true;
+	};
+	if (! define(name + ".memo.hits", entry.hits) || ! define(name + ".memo.misses", entry.misses)) {
+		counters.pop_back();
+		return nullptr;
+	}
+	return slot = &entry;
+}
+
+static void count(llvm::IRBuilder<>& build, Memo_Counters* counters, const std::string& symbol) {
+	if (! counters) { return; }
+	auto global { build.GetInsertBlock()->getModule()->getOrInsertGlobal(symbol, build.getInt64Ty()) };
+	auto value { build.CreateAdd(build.CreateLoad(build.getInt64Ty(), global), build.getInt64(1)) };
+	build.CreateStore(value, global);
+}
+
+llvm::Function* memoize(llvm::Function& function) {
+	if (! table_bits) { return &function; }
+	if (! is_pure(function)) { return &function; }
+	std::string name { function.getName() };
+	pure_functions.insert(name);
+	if (function.arg_empty() || ! worth_caching(function)) { return &function; }
+
+	auto& context { function.getContext() };
+	auto& module { *function.getParent() };
+	llvm::IRBuilder<> build { context };
+	auto arity { static_cast<unsigned>(function.arg_size()) };
+	auto keys_type { llvm::ArrayType::get(build.getInt64Ty(), arity) };
+	auto entry_type { llvm::StructType::get(context, { keys_type, build.getDoubleTy(), build.getInt8Ty() }) };
+	auto table_type { llvm::ArrayType::get(entry_type, std::uint64_t { 1 } << table_bits) };
+	auto table { new llvm::GlobalVariable(
+		module, table_type, false, llvm::GlobalValue::InternalLinkage,
+		llvm::ConstantAggregateZero::get(table_type), name + ".memo"
+	) };
+
+	auto wrapper { llvm::Function::Create(
+		function.getFunctionType(), function.getLinkage(), "", &module
+	) };
+	wrapper->copyAttributesFrom(&function);
+	function.replaceAllUsesWith(wrapper);
+	wrapper->takeName(&function);
+	function.setName(name + ".uncached");
+	function.setLinkage(llvm::GlobalValue::InternalLinkage);
+	auto stats { function_counters(name) };
+
+	auto entry_bb { llvm::BasicBlock::Create(context, "entry", wrapper) };
+	auto hit_bb { llvm::BasicBlock::Create(context, "hit", wrapper) };
+	auto miss_bb { llvm::BasicBlock::Create(context, "miss", wrapper) };
+	build.SetInsertPoint(entry_bb);
+	llvm::SmallVector<llvm::Value*, 4> args;
+	llvm::SmallVector<llvm::Value*, 4> keys;
+	llvm::Value* hash { build.getInt64(0) };
+	for (auto& arg : wrapper->args()) {
+		args.push_back(&arg);
+		keys.push_back(build.CreateBitCast(&arg, build.getInt64Ty()));
+		hash = build.CreateMul(build.CreateXor(hash, keys.back()), build.getInt64(0x9e3779b97f4a7c15));
+	}
+	auto index { build.CreateLShr(hash, 64 - table_bits) };
+	auto slot { build.CreateInBoundsGEP(table_type, table, { build.getInt64(0), index }) };
+	auto field = [&](unsigned i) { return build.CreateStructGEP(entry_type, slot, i); };
+	auto key = [&](unsigned i) {
+		return build.CreateInBoundsGEP(keys_type, field(0), { build.getInt64(0), build.getInt64(i) });
+	};
+	auto hit { build.CreateICmpNE(build.CreateLoad(build.getInt8Ty(), field(2)), build.getInt8(0)) };
+	for (unsigned i { 0 }; i < arity; ++i) {
+		hit = build.CreateAnd(hit, build.CreateICmpEQ(build.CreateLoad(build.getInt64Ty(), key(i)), keys[i]));
+	}
+	build.CreateCondBr(hit, hit_bb, miss_bb);
+
+	build.SetInsertPoint(hit_bb);
+	count(build, stats, name + ".memo.hits");
+	build.CreateRet(build.CreateLoad(build.getDoubleTy(), field(1)));
+
+	build.SetInsertPoint(miss_bb);
+	count(build, stats, name + ".memo.misses");
+	auto value { build.CreateCall(&function, args) };
+	value->setCallingConv(function.getCallingConv());
+	for (unsigned i { 0 }; i < arity; ++i) { build.CreateStore(keys[i], key(i)); }
+	build.CreateStore(value, field(1));
+	build.CreateStore(build.getInt8(1), field(2));
+	build.CreateRet(value);
+	return wrapper;
+}
+
+void print_memo_stats(std::ostream& out) {
+	for (const auto& entry : counters) {
+		auto calls { entry.hits + entry.misses };
+		out << "memo: " << entry.name << ' ' << entry.hits << " hits, " << entry.misses << " misses";
+		if (calls) { out << " (" << 100.0 * static_cast<double>(entry.hits) / static_cast<double>(calls) << "% hit rate)"; }
+		out << '\n';
+	}
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <iosfwd>
+#include <llvm/IR/Function.h>
+
+void enable_memoization(unsigned entries);
+llvm::Function* memoize(llvm::Function& function);
+void print_memo_stats(std::ostream& out);
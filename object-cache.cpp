@@ -0,0 +1,104 @@
+#include "object-cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+#include <vector>
+
+std::uint64_t Object_Cache::key(const llvm::Module& module) const {
+	llvm::SmallString<4096> bytes;
+	llvm::raw_svector_ostream out { bytes };
+	llvm::WriteBitcodeToFile(module, out);
+	out << '\0' << module.getTargetTriple() << '\0' << salt_;
+	return llvm::xxHash64(bytes.str());
+}
+
+std::string Object_Cache::path(std::uint64_t key) const {
+	llvm::SmallString<128> result { directory_ };
+	llvm::sys::path::append(result, llvm::utohexstr(key, true, 16) + ".o");
+	return std::string { result.str() };
+}
+
+std::unique_ptr<llvm::MemoryBuffer> Object_Cache::getObject(const llvm::Module* module) {
+	auto k { key(*module) };
+	auto file { path(k) };
+	int fd;
+	if (! llvm::sys::fs::openFileForRead(file, fd)) {
+		auto buffer { llvm::MemoryBuffer::getOpenFile(fd, file, -1, false) };
+		llvm::sys::fs::setLastAccessAndModificationTime(fd, std::chrono::system_clock::now());
+		llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+		if (buffer) {
+			++hits_;
+			return std::move(*buffer);
+		}
+	}
+	++misses_;
+	std::lock_guard lock { pending_mutex_ };
+	pending_[module] = k;
+	return nullptr;
+}
+
+void Object_Cache::notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) {
+	std::uint64_t k;
+	{
+		std::lock_guard lock { pending_mutex_ };
+		auto found { pending_.find(module) };
+		if (found == pending_.end()) { return; }
+		k = found->second;
+		pending_.erase(found);
+	}
+	int fd;
+	llvm::SmallString<128> temporary;
+	auto model { directory_ + "/%%%%%%%%.tmp" };
+	if (llvm::sys::fs::createUniqueFile(model, fd, temporary)) { return; }
+	{
+		llvm::raw_fd_ostream out { fd, true };
+		out << object.getBuffer();
+		if (out.has_error()) {
+			out.clear_error();
+			llvm::sys::fs::remove(temporary);
+			return;
+		}
+	}
+	if (llvm::sys::fs::rename(temporary, path(k))) {
+		llvm::sys::fs::remove(temporary);
+		return;
+	}
+	// Only scan the directory once, and again when the running total passes the limit.
+	std::lock_guard lock { size_mutex_ };
+	size_ += object.getBufferSize();
+	if (! size_known_ || size_ > size_limit_) {
+		size_ = evict();
+		size_known_ = true;
+	}
+}
+
+std::uint64_t Object_Cache::evict() {
+	struct Entry { std::string path; std::uint64_t size; llvm::sys::TimePoint<> used; };
+	std::vector<Entry> entries;
+	std::uint64_t total { 0 };
+	std::error_code ec;
+	for (llvm::sys::fs::directory_iterator it { directory_, ec }, end; it != end && ! ec; it.increment(ec)) {
+		if (llvm::sys::path::extension(it->path()) != ".o") { continue; }
+		llvm::sys::fs::file_status status;
+		if (llvm::sys::fs::status(it->path(), status)) { continue; }
+		entries.push_back({ it->path(), status.getSize(), status.getLastModificationTime() });
+		total += status.getSize();
+	}
+	if (total <= size_limit_) { return total; }
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+	for (const auto& entry : entries) {
+		if (total <= size_limit_) { break; }
+		if (! llvm::sys::fs::remove(entry.path)) { total -= entry.size; }
+	}
+	return total;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <mutex>
+#include <string>
+
+class Object_Cache: public llvm::ObjectCache {
+		std::string directory_;
+		std::string salt_;
+		std::uint64_t size_limit_;
+		std::mutex size_mutex_;
+		std::uint64_t size_ { 0 };
+		bool size_known_ { false };
+		std::atomic<unsigned> hits_ { 0 };
+		std::atomic<unsigned> misses_ { 0 };
+		std::mutex pending_mutex_;
+		llvm::DenseMap<const llvm::Module*, std::uint64_t> pending_;
+
+		std::uint64_t key(const llvm::Module& module) const;
+		std::string path(std::uint64_t key) const;
+		std::uint64_t evict();
+
+	public:
+		Object_Cache(std::string directory, std::uint64_t size_limit):
+			directory_ { std::move(directory) }, size_limit_ { size_limit }
+		{ }
+
+		// Objects are only reused for the same salt; it must describe the
+		// resolved target and be set before the first module is compiled.
+		void set_salt(std::string salt) { salt_ = std::move(salt); }
+
+		void notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) override;
+		std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* module) override;
+
+		[[nodiscard]] unsigned hits() const { return hits_; }
+		[[nodiscard]] unsigned misses() const { return misses_; }
+};
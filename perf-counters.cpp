@@ -0,0 +1,113 @@
+#include "perf-counters.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ostream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct Perf_Event {
+	const char* name;
+	std::uint32_t type;
+	std::uint64_t config;
+};
+
+static constexpr std::uint64_t cache_miss(std::uint64_t cache) {
+	return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+static constexpr Perf_Event hardware_events[] {
+	{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	{ "L1d-misses", PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_L1D) },
+	{ "LLC-misses", PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_LL) },
+};
+
+static constexpr Perf_Event software_events[] {
+	{ "task-clock-ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+	{ "page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+	{ "context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+};
+
+template<std::size_t N> void Perf_Counters::open(const Perf_Event (&events)[N]) {
+	for (const auto& event : events) {
+		perf_event_attr attr { };
+		attr.size = sizeof attr;
+		attr.type = event.type;
+		attr.config = event.config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		auto fd { static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0)) };
+		if (fd < 0) {
+			if (error_.empty()) { error_ = std::string { event.name } + ": " + std::strerror(errno); }
+			continue;
+		}
+		counters_.push_back({ event.name, fd });
+	}
+}
+
+bool Perf_Counters::open() {
+	open(hardware_events);
+	if (counters_.empty()) {
+		// Virtual machines often expose no PMU; software events still work there.
+		software_ = true;
+		open(software_events);
+	}
+	return available();
+}
+
+Perf_Counters::~Perf_Counters() {
+	for (const auto& counter : counters_) { close(counter.fd); }
+}
+
+void Perf_Counters::start() {
+	for (const auto& counter : counters_) {
+		ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+void Perf_Counters::stop() {
+	for (const auto& counter : counters_) { ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0); }
+}
+
+void Perf_Counters::print(std::ostream& out) const {
+	const char* separator { "" };
+	for (const auto& counter : counters_) {
+		struct { std::uint64_t value, enabled, running; } reading { };
+		out << separator << counter.name << ' ';
+		separator = ", ";
+		if (read(counter.fd, &reading, sizeof reading) != sizeof reading || ! reading.running) {
+			out << "n/a";
+			continue;
+		}
+		if (reading.running < reading.enabled) {
+			// The kernel multiplexed this counter; extrapolate to the whole run.
+			reading.value = static_cast<std::uint64_t>(
+				static_cast<double>(reading.value) * reading.enabled / reading.running
+			);
+		}
+		out << reading.value;
+	}
+}
+
+#else
+
+bool Perf_Counters::open() {
+	error_ = "perf_event_open is only available on Linux";
+	return false;
+}
+
+Perf_Counters::~Perf_Counters() = default;
+void Perf_Counters::start() { }
+void Perf_Counters::stop() { }
+void Perf_Counters::print(std::ostream&) const { }
+
+#endif
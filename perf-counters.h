@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+struct Perf_Event;
+
+class Perf_Counters {
+		struct Counter {
+			const char* name;
+			int fd;
+		};
+
+		std::vector<Counter> counters_;
+		std::string error_;
+		bool software_ { false };
+
+		template<std::size_t N> void open(const Perf_Event (&events)[N]);
+
+	public:
+		Perf_Counters() = default;
+		Perf_Counters(const Perf_Counters&) = delete;
+		Perf_Counters& operator=(const Perf_Counters&) = delete;
+		~Perf_Counters();
+
+		bool open();
+		[[nodiscard]] bool available() const { return ! counters_.empty(); }
+		[[nodiscard]] const std::string& error() const { return error_; }
+		[[nodiscard]] bool software() const { return software_; }
+
+		void start();
+		void stop();
+		void print(std::ostream& out) const;
+};
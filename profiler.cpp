@@ -0,0 +1,206 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <llvm/ADT/SmallVector.h>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "jit-listeners.h"
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+static constexpr std::size_t max_depth { 32 };
+static constexpr std::size_t max_samples { 16384 };
+
+struct Sample {
+	std::uint32_t depth;
+	std::uintptr_t frames[max_depth];
+};
+
+// The handler only touches this preallocated state, so it stays async-signal-safe.
+static std::unique_ptr<Sample[]> samples;
+static std::atomic<std::size_t> next_sample { 0 };
+static std::uintptr_t stack_low;
+static std::uintptr_t stack_high;
+static timer_t sampling_timer;
+
+static void on_sigprof(int, siginfo_t*, void* context) {
+	auto index { next_sample.fetch_add(1, std::memory_order_relaxed) };
+	if (index >= max_samples) { return; }
+	const auto& registers { static_cast<ucontext_t*>(context)->uc_mcontext };
+#ifdef __x86_64__
+	auto pc { static_cast<std::uintptr_t>(registers.gregs[REG_RIP]) };
+	auto fp { static_cast<std::uintptr_t>(registers.gregs[REG_RBP]) };
+#else
+	auto pc { static_cast<std::uintptr_t>(registers.pc) };
+	auto fp { static_cast<std::uintptr_t>(registers.regs[29]) };
+#endif
+	auto& sample { samples[index] };
+	std::uint32_t depth { 0 };
+	sample.frames[depth++] = pc;
+	// JIT'd code keeps frame pointers; stop at the first frame that leaves this stack.
+	while (
+		depth < max_depth && fp % alignof(std::uintptr_t) == 0 &&
+		fp >= stack_low && fp + 2 * sizeof(std::uintptr_t) <= stack_high
+	) {
+		auto frame { reinterpret_cast<const std::uintptr_t*>(fp) };
+		if (! frame[1]) { break; }
+		sample.frames[depth++] = frame[1];
+		if (frame[0] <= fp) { break; }
+		fp = frame[0];
+	}
+	sample.depth = depth;
+}
+
+bool Sampling_Profiler::open() {
+	pthread_attr_t attr;
+	if (pthread_getattr_np(pthread_self(), &attr)) {
+		error_ = "can't find the stack bounds";
+		return false;
+	}
+	void* low;
+	std::size_t size;
+	pthread_attr_getstack(&attr, &low, &size);
+	pthread_attr_destroy(&attr);
+	stack_low = reinterpret_cast<std::uintptr_t>(low);
+	stack_high = stack_low + size;
+	samples = std::make_unique<Sample[]>(max_samples);
+	struct sigaction action { };
+	action.sa_sigaction = on_sigprof;
+	action.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	if (sigaction(SIGPROF, &action, nullptr)) {
+		error_ = std::string { "sigaction: " } + std::strerror(errno);
+		return false;
+	}
+	// Count this thread's CPU time and signal only this thread: the handler walks
+	// its stack, and compile threads must not take the samples.
+	sigevent event { };
+	event.sigev_notify = SIGEV_THREAD_ID;
+	event.sigev_signo = SIGPROF;
+	event.sigev_notify_thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+	if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &sampling_timer)) {
+		error_ = std::string { "timer_create: " } + std::strerror(errno);
+		return false;
+	}
+	installed_ = true;
+	return true;
+}
+
+void Sampling_Profiler::start() {
+	if (! installed_) { return; }
+	next_sample.store(0, std::memory_order_relaxed);
+	itimerspec timer { };
+	timer.it_interval.tv_nsec = static_cast<long>(interval_ % 1000000) * 1000;
+	timer.it_interval.tv_sec = static_cast<time_t>(interval_ / 1000000);
+	timer.it_value = timer.it_interval;
+	timer_settime(sampling_timer, 0, &timer, nullptr);
+}
+
+void Sampling_Profiler::stop() {
+	if (! installed_) { return; }
+	itimerspec timer { };
+	timer_settime(sampling_timer, 0, &timer, nullptr);
+	collected_ = true;
+}
+
+void Sampling_Profiler::report(std::ostream& out, Function_Map_Listener& functions) {
+	collected_ = false;
+	auto taken { next_sample.load(std::memory_order_relaxed) };
+	auto count { std::min(taken, max_samples) };
+	struct Counts {
+		std::size_t self { 0 };
+		std::size_t total { 0 };
+	};
+	std::map<std::string, Counts> flat;
+	std::map<std::pair<std::string, std::string>, std::size_t> edges;
+	std::unordered_map<std::uintptr_t, std::string> names;
+	std::size_t native { 0 };
+	auto name_of = [&](std::uintptr_t address) -> const std::string& {
+		auto [found, inserted] { names.try_emplace(address) };
+		if (inserted) { found->second = functions.find(address); }
+		return found->second;
+	};
+	for (std::size_t i { 0 }; i < count; ++i) {
+		const auto& sample { samples[i] };
+		llvm::SmallVector<const std::string*, max_depth> stack;
+		for (std::uint32_t depth { 0 }; depth < sample.depth; ++depth) {
+			// Return addresses point past the call, which may be past the caller's end.
+			const auto& name { name_of(depth ? sample.frames[depth] - 1 : sample.frames[depth]) };
+			if (name.empty()) { break; }
+			stack.push_back(&name);
+		}
+		if (stack.empty()) { ++native; continue; }
+		++flat[*stack.front()].self;
+		llvm::SmallVector<const std::string*, max_depth> seen;
+		for (auto name : stack) {
+			if (std::any_of(seen.begin(), seen.end(), [&](auto other) { return *other == *name; })) { continue; }
+			seen.push_back(name);
+			++flat[*name].total;
+		}
+		std::vector<std::pair<std::string, std::string>> seen_edges;
+		for (std::size_t depth { 1 }; depth < stack.size(); ++depth) {
+			std::pair<std::string, std::string> edge { *stack[depth], *stack[depth - 1] };
+			if (std::find(seen_edges.begin(), seen_edges.end(), edge) != seen_edges.end()) { continue; }
+			++edges[edge];
+			seen_edges.push_back(std::move(edge));
+		}
+	}
+	out << "profile: " << count << " samples every " << interval_ << " us";
+	if (native) { out << ", " << native << " outside JIT'd code"; }
+	if (taken > count) { out << ", " << taken - count << " dropped"; }
+	out << '\n';
+	if (! count) { return; }
+	std::vector<std::pair<std::string, Counts>> rows(flat.begin(), flat.end());
+	std::stable_sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+		return a.second.self != b.second.self ? a.second.self > b.second.self : a.second.total > b.second.total;
+	});
+	auto percent = [&](std::size_t n) {
+		char buffer[16];
+		std::snprintf(buffer, sizeof buffer, "%6.1f%%", 100.0 * static_cast<double>(n) / static_cast<double>(count));
+		return std::string { buffer };
+	};
+	out << "   self   total  function\n";
+	for (const auto& [name, counts] : rows) {
+		out << percent(counts.self) << ' ' << percent(counts.total) << "  " << name << '\n';
+	}
+	if (edges.empty()) { return; }
+	std::vector<std::pair<std::pair<std::string, std::string>, std::size_t>> arcs(edges.begin(), edges.end());
+	std::stable_sort(arcs.begin(), arcs.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+	out << "  samples  caller -> callee\n";
+	for (const auto& [edge, n] : arcs) {
+		char buffer[16];
+		std::snprintf(buffer, sizeof buffer, "%9zu", n);
+		out << buffer << "  " << edge.first << " -> " << edge.second << '\n';
+	}
+}
+
+#else
+
+bool Sampling_Profiler::open() {
+	error_ = "sampling needs Linux on x86-64 or AArch64";
+	return false;
+}
+
+void Sampling_Profiler::start() { }
+void Sampling_Profiler::stop() { }
+void Sampling_Profiler::report(std::ostream&, Function_Map_Listener&) { collected_ = false; }
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+class Function_Map_Listener;
+
+class Sampling_Profiler {
+		std::string error_;
+		unsigned interval_;
+		bool installed_ { false };
+		bool collected_ { false };
+
+	public:
+		explicit Sampling_Profiler(unsigned interval_us = 1000): interval_ { interval_us } { }
+		Sampling_Profiler(const Sampling_Profiler&) = delete;
+		Sampling_Profiler& operator=(const Sampling_Profiler&) = delete;
+
+		bool open();
+		[[nodiscard]] const std::string& error() const { return error_; }
+		[[nodiscard]] bool collected() const { return collected_; }
+
+		void start();
+		void stop();
+		void report(std::ostream& out, Function_Map_Listener& functions);
+};
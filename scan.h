@@ -0,0 +1,115 @@
+#pragma once
+
+#if !defined(KALEIDOSCOPE_SCALAR_SCAN) && (defined(__SSE2__) || defined(__AVX2__))
+	#include <immintrin.h>
+#endif
+
+namespace scan {
+	inline bool in_range(unsigned char c, unsigned char lo, unsigned char hi) {
+		return static_cast<unsigned char>(c - lo) <= hi - lo;
+	}
+
+	inline bool is_space(char c) { return c == ' ' || in_range(c, '\t', '\r'); }
+	inline bool is_alpha(char c) { return in_range(c | 0x20, 'a', 'z'); }
+	inline bool is_digit(char c) { return in_range(c, '0', '9'); }
+	inline bool is_alnum(char c) { return is_alpha(c) || is_digit(c); }
+	inline bool is_number(char c) { return is_digit(c) || c == '.'; }
+	inline bool is_comment(char c) { return static_cast<unsigned char>(c) >= ' '; }
+
+	namespace scalar {
+		inline const char* skip_space(const char* p, const char* end) {
+			while (p < end && is_space(*p)) { ++p; }
+			return p;
+		}
+		inline const char* skip_alnum(const char* p, const char* end) {
+			while (p < end && is_alnum(*p)) { ++p; }
+			return p;
+		}
+		inline const char* skip_number(const char* p, const char* end) {
+			while (p < end && is_number(*p)) { ++p; }
+			return p;
+		}
+		inline const char* skip_comment(const char* p, const char* end) {
+			while (p < end && is_comment(*p)) { ++p; }
+			return p;
+		}
+	}
+
+#if !defined(KALEIDOSCOPE_SCALAR_SCAN) && defined(__AVX2__)
+	namespace vector {
+		constexpr int width { 32 };
+		using Block = __m256i;
+
+		inline Block load(const char* p) {
+			return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+		}
+		inline Block splat(int c) { return _mm256_set1_epi8(static_cast<char>(c)); }
+		inline Block either(Block a, Block b) { return _mm256_or_si256(a, b); }
+		inline Block equal(Block x, char c) { return _mm256_cmpeq_epi8(x, splat(c)); }
+		inline Block in_range(Block x, unsigned char lo, unsigned char hi) {
+			auto biased { _mm256_add_epi8(x, splat(128 - lo)) };
+			return _mm256_cmpgt_epi8(splat(-128 + (hi - lo) + 1), biased);
+		}
+		inline unsigned mask(Block x) { return static_cast<unsigned>(_mm256_movemask_epi8(x)); }
+	}
+#elif !defined(KALEIDOSCOPE_SCALAR_SCAN) && defined(__SSE2__)
+	namespace vector {
+		constexpr int width { 16 };
+		using Block = __m128i;
+
+		inline Block load(const char* p) {
+			return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		}
+		inline Block splat(int c) { return _mm_set1_epi8(static_cast<char>(c)); }
+		inline Block either(Block a, Block b) { return _mm_or_si128(a, b); }
+		inline Block equal(Block x, char c) { return _mm_cmpeq_epi8(x, splat(c)); }
+		inline Block in_range(Block x, unsigned char lo, unsigned char hi) {
+			auto biased { _mm_add_epi8(x, splat(128 - lo)) };
+			return _mm_cmplt_epi8(biased, splat(-128 + (hi - lo) + 1));
+		}
+		inline unsigned mask(Block x) { return static_cast<unsigned>(_mm_movemask_epi8(x)); }
+	}
+#endif
+
+#if !defined(KALEIDOSCOPE_SCALAR_SCAN) && (defined(__SSE2__) || defined(__AVX2__))
+	namespace vector {
+		constexpr unsigned all { width == 32 ? ~0u : (1u << width) - 1 };
+
+		inline Block space(Block x) { return either(equal(x, ' '), in_range(x, '\t', '\r')); }
+		inline Block alnum(Block x) {
+			return either(in_range(either(x, splat(0x20)), 'a', 'z'), in_range(x, '0', '9'));
+		}
+		inline Block number(Block x) { return either(in_range(x, '0', '9'), equal(x, '.')); }
+		inline Block comment(Block x) { return in_range(x, ' ', 0xff); }
+
+		template<typename Class, typename Scalar>
+		inline const char* skip(const char* p, const char* end, Class cls, Scalar scalar) {
+			while (end - p >= width) {
+				auto stop { ~mask(cls(load(p))) & all };
+				if (stop) { return p + __builtin_ctz(stop); }
+				p += width;
+			}
+			return scalar(p, end);
+		}
+	}
+
+	inline const char* skip_space(const char* p, const char* end) {
+		if (p < end && ! is_space(*p)) { return p; }
+		return vector::skip(p, end, vector::space, scalar::skip_space);
+	}
+	inline const char* skip_alnum(const char* p, const char* end) {
+		return vector::skip(p, end, vector::alnum, scalar::skip_alnum);
+	}
+	inline const char* skip_number(const char* p, const char* end) {
+		return vector::skip(p, end, vector::number, scalar::skip_number);
+	}
+	inline const char* skip_comment(const char* p, const char* end) {
+		return vector::skip(p, end, vector::comment, scalar::skip_comment);
+	}
+#else
+	using scalar::skip_space;
+	using scalar::skip_alnum;
+	using scalar::skip_number;
+	using scalar::skip_comment;
+#endif
+}
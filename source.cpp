@@ -0,0 +1,73 @@
+#include "source.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Source source;
+
+static constexpr std::size_t block_size { 64 * 1024 };
+
+void Source::close() {
+	if (mapped_) { munmap(mapped_, mapped_size_); }
+	if (fd_ > 0) { ::close(fd_); }
+	mapped_ = nullptr;
+	mapped_size_ = 0;
+	buffer_.clear();
+	fd_ = -1;
+	error_ = 0;
+	begin_ = end_ = nullptr;
+	eof_ = true;
+}
+
+bool Source::map(int fd, std::size_t size) {
+	if (size == 0) { return true; }
+	auto mapped { mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) };
+	if (mapped == MAP_FAILED) { return false; }
+	madvise(mapped, size, MADV_SEQUENTIAL);
+	mapped_ = mapped;
+	mapped_size_ = size;
+	begin_ = static_cast<const char*>(mapped);
+	end_ = begin_ + size;
+	return true;
+}
+
+bool Source::open(const char* path) {
+	close();
+	fd_ = ::open(path, O_RDONLY);
+	if (fd_ < 0) { return false; }
+	struct stat st;
+	if (fstat(fd_, &st) == 0 && S_ISREG(st.st_mode) &&
+		map(fd_, static_cast<std::size_t>(st.st_size))
+	) { return true; }
+	eof_ = false;
+	return true;
+}
+
+void Source::open_stdin() {
+	close();
+	struct stat st;
+	if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode) &&
+		map(STDIN_FILENO, static_cast<std::size_t>(st.st_size))
+	) { return; }
+	fd_ = STDIN_FILENO;
+	eof_ = false;
+}
+
+bool Source::fill() {
+	if (eof_) { return false; }
+	auto old_size { buffer_.size() };
+	buffer_.resize(old_size + block_size);
+	ssize_t got;
+	do {
+		got = read(fd_, buffer_.data() + old_size, block_size);
+	} while (got < 0 && errno == EINTR);
+	if (got < 0) { error_ = errno; }
+	buffer_.resize(old_size + (got > 0 ? got : 0));
+	if (got <= 0) { eof_ = true; return false; }
+	begin_ = buffer_.data();
+	end_ = begin_ + buffer_.size();
+	return true;
+}
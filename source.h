@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class Source {
+		const char* begin_ { nullptr };
+		const char* end_ { nullptr };
+		void* mapped_ { nullptr };
+		std::size_t mapped_size_ { 0 };
+		std::string buffer_;
+		int fd_ { -1 };
+		int error_ { 0 };
+		bool eof_ { true };
+
+		void close();
+		bool map(int fd, std::size_t size);
+
+	public:
+		Source() = default;
+		Source(const Source&) = delete;
+		Source& operator=(const Source&) = delete;
+		~Source() { close(); }
+
+		bool open(const char* path);
+		void open_stdin();
+
+		[[nodiscard]] const char* begin() const { return begin_; }
+		[[nodiscard]] const char* end() const { return end_; }
+
+		bool fill();
+		// The errno of a failed read; fill() reports it as the end of input.
+		[[nodiscard]] int error() const { return error_; }
+};
+
+extern Source source;
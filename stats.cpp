@@ -0,0 +1,110 @@
+#include "stats.h"
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+bool collect_stats { false };
+
+static constexpr std::size_t phase_count { 7 };
+static constexpr const char* phase_names[phase_count] {
+	"lex", "parse", "codegen", "optimize", "jit-add", "jit-lookup", "execute"
+};
+
+struct Phase_Totals {
+	std::array<double, phase_count> seconds { };
+	std::array<std::uint64_t, phase_count> calls { };
+};
+
+struct Item {
+	std::string kind;
+	std::string name;
+	Phase_Totals totals;
+};
+
+static Phase_Totals totals;
+static Phase_Totals item_start;
+static std::vector<Item> items;
+static Phase_Timer* innermost { nullptr };
+
+Phase_Timer::Phase_Timer(Phase phase): phase_ { phase }, active_ { collect_stats } {
+	if (! active_) { return; }
+	outer_ = innermost;
+	innermost = this;
+	start_ = std::chrono::steady_clock::now();
+}
+
+Phase_Timer::~Phase_Timer() {
+	if (! active_) { return; }
+	std::chrono::duration<double> elapsed { std::chrono::steady_clock::now() - start_ };
+	auto index { static_cast<std::size_t>(phase_) };
+	totals.seconds[index] += elapsed.count();
+	++totals.calls[index];
+	if (outer_) { totals.seconds[static_cast<std::size_t>(outer_->phase_)] -= elapsed.count(); }
+	innermost = outer_;
+}
+
+Untimed::Untimed(): active_ { collect_stats && innermost } {
+	if (active_) { start_ = std::chrono::steady_clock::now(); }
+}
+
+Untimed::~Untimed() {
+	if (! active_) { return; }
+	auto elapsed { std::chrono::steady_clock::now() - start_ };
+	for (auto timer { innermost }; timer; timer = timer->outer_) { timer->start_ += elapsed; }
+}
+
+void begin_item() {
+	if (collect_stats) { item_start = totals; }
+}
+
+void end_item(std::string_view kind, std::string_view name) {
+	if (! collect_stats) { return; }
+	items.push_back({ std::string { kind }, std::string { name }, { } });
+	auto& item { items.back().totals };
+	for (std::size_t i { 0 }; i < phase_count; ++i) {
+		item.seconds[i] = totals.seconds[i] - item_start.seconds[i];
+		item.calls[i] = totals.calls[i] - item_start.calls[i];
+	}
+}
+
+static std::string milliseconds(double seconds) {
+	char text[32];
+	std::snprintf(text, sizeof text, "%10.3f", seconds * 1e3);
+	return text;
+}
+
+void print_stats(std::ostream& out, bool per_item) {
+	double total { 0.0 };
+	for (auto seconds : totals.seconds) { total += seconds; }
+	out << "===- phase timing -===\n";
+	out << "  phase            ms      calls\n";
+	for (std::size_t i { 0 }; i < phase_count; ++i) {
+		char row[64];
+		std::snprintf(row, sizeof row, "  %-10s %s %10llu\n", phase_names[i],
+			milliseconds(totals.seconds[i]).c_str(), static_cast<unsigned long long>(totals.calls[i])
+		);
+		out << row;
+	}
+	out << "  total      " << milliseconds(total) << "    " << items.size() << " items\n";
+	if (! per_item) { return; }
+	out << "===- per item (ms) -===\n  #     kind        ";
+	for (auto name : phase_names) {
+		char column[16];
+		std::snprintf(column, sizeof column, "%11s", name);
+		out << column;
+	}
+	out << "  name\n";
+	for (std::size_t n { 0 }; n < items.size(); ++n) {
+		char number[24];
+		std::snprintf(number, sizeof number, "  %-5zu ", n);
+		char kind[16];
+		std::snprintf(kind, sizeof kind, "%-11s ", items[n].kind.c_str());
+		out << number << kind;
+		for (auto seconds : items[n].totals.seconds) { out << ' ' << milliseconds(seconds); }
+		out << "  " << items[n].name << '\n';
+	}
+}
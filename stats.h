@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+#include <iosfwd>
+#include <string_view>
+
+enum class Phase { lex, parse, codegen, optimize, jit_add, jit_lookup, execute };
+
+extern bool collect_stats;
+
+class Phase_Timer {
+		Phase phase_;
+		bool active_;
+		Phase_Timer* outer_ { nullptr };
+		std::chrono::steady_clock::time_point start_;
+
+	public:
+		explicit Phase_Timer(Phase phase);
+		Phase_Timer(const Phase_Timer&) = delete;
+		Phase_Timer& operator=(const Phase_Timer&) = delete;
+		~Phase_Timer();
+
+		friend class Untimed;
+};
+
+// Leaves the time spent in its scope, e.g. waiting for input, out of every running Phase_Timer.
+class Untimed {
+		bool active_;
+		std::chrono::steady_clock::time_point start_;
+
+	public:
+		Untimed();
+		Untimed(const Untimed&) = delete;
+		Untimed& operator=(const Untimed&) = delete;
+		~Untimed();
+};
+
+void begin_item();
+void end_item(std::string_view kind, std::string_view name);
+void print_stats(std::ostream& out, bool per_item);
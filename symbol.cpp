@@ -0,0 +1,17 @@
+#include "symbol.h"
+
+#include <llvm/ADT/StringMap.h>
+#include <vector>
+
+static llvm::StringMap<Symbol> symbols;
+static std::vector<std::string_view> names;
+
+Symbol intern(std::string_view name) {
+	auto [entry, inserted] { symbols.try_emplace(name, static_cast<Symbol>(names.size())) };
+	if (inserted) { names.emplace_back(entry->getKey().data(), entry->getKey().size()); }
+	return entry->getValue();
+}
+
+std::string_view symbol_name(Symbol symbol) { return names[symbol]; }
+
+std::size_t symbol_count() { return names.size(); }
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+using Symbol = std::uint32_t;
+
+Symbol intern(std::string_view name);
+std::string_view symbol_name(Symbol symbol);
+std::size_t symbol_count();
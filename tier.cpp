@@ -0,0 +1,91 @@
+#include "tier.h"
+
+#include "code.h"
+
+#include <cstdint>
+#include <iostream>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <string>
+
+static unsigned hot_calls { 0 };
+static unsigned tiered { 0 };
+static unsigned promoted { 0 };
+
+static llvm::Error add_current_module() {
+	auto error { the_jit->addModule(llvm::orc::ThreadSafeModule(std::move(the_module), std::move(the_context))) };
+	init_module_and_fpm();
+	return error;
+}
+
+static void add_call_counter(llvm::Function& function, Symbol symbol) {
+	auto& context { function.getContext() };
+	auto& module { *function.getParent() };
+	auto& body { function.getEntryBlock() };
+	llvm::IRBuilder<> build { context };
+	auto counter { new llvm::GlobalVariable(
+		module, build.getInt64Ty(), false, llvm::GlobalValue::InternalLinkage,
+		build.getInt64(0), function.getName() + ".calls"
+	) };
+	auto count_bb { llvm::BasicBlock::Create(context, "count", &function, &body) };
+	auto promote_bb { llvm::BasicBlock::Create(context, "promote", &function, &body) };
+	build.SetInsertPoint(count_bb);
+	auto calls { build.CreateAdd(build.CreateLoad(build.getInt64Ty(), counter), build.getInt64(1)) };
+	build.CreateStore(calls, counter);
+	build.CreateCondBr(build.CreateICmpEQ(calls, build.getInt64(hot_calls)), promote_bb, &body);
+	build.SetInsertPoint(promote_bb);
+	auto promote { module.getOrInsertFunction(
+		"kaleidoscope_promote", build.getVoidTy(), build.getInt32Ty()
+	) };
+	build.CreateCall(promote, build.getInt32(symbol));
+	build.CreateBr(&body);
+}
+
+extern "C" void kaleidoscope_promote(std::uint32_t symbol) {
+	auto function { ast::defined_function(symbol) };
+	if (! function) { return; }
+	auto name { std::string { function->prototype().name() } };
+	auto ir { function->generate_code() };
+	if (! ir) { return; }
+	ir->setName(name + ".tier1");
+	optimize_module(*the_module);
+	auto address { [&]() -> llvm::Expected<llvm::JITTargetAddress> {
+		if (auto error { add_current_module() }) { return error; }
+		auto optimized { the_jit->lookup(name + ".tier1") };
+		if (! optimized) { return optimized.takeError(); }
+		return optimized->getAddress();
+	}() };
+	if (! address) {
+		llvm::logAllUnhandledErrors(address.takeError(), llvm::errs(), "Error: ");
+		return;
+	}
+	if (auto error { the_jit->redirectStub(name, *address) }) {
+		llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "Error: ");
+		return;
+	}
+	++promoted;
+}
+
+llvm::Error enable_tiering(unsigned hot_threshold) {
+	hot_calls = hot_threshold;
+	return the_jit->defineAbsolute(
+		"kaleidoscope_promote", llvm::pointerToJITTargetAddress(&kaleidoscope_promote)
+	);
+}
+
+llvm::Error add_tiered_definition(ast::Function_Ptr function) {
+	function->retain();
+	auto ir { function->generate_code() };
+	if (! ir) { return llvm::Error::success(); }
+	auto name { std::string { function->prototype().name() } };
+	ir->setName(name + ".tier0");
+	add_call_counter(*ir, function->prototype().symbol());
+	if (auto error { add_current_module() }) { return error; }
+	if (auto error { the_jit->addStub(name, name + ".tier0") }) { return error; }
+	ast::define_function(std::move(function));
+	++tiered;
+	return llvm::Error::success();
+}
+
+unsigned tiered_functions() { return tiered; }
+unsigned promoted_functions() { return promoted; }
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <llvm/Support/Error.h>
+
+#include "ast-expression.h"
+
+llvm::Error enable_tiering(unsigned hot_threshold);
+llvm::Error add_tiered_definition(ast::Function_Ptr function);
+unsigned tiered_functions();
+unsigned promoted_functions();
@@ -1,68 +1,123 @@
 #include "tok.h"
+#include "scan.h"
+#include "source.h"
+#include "stats.h"
+
+#include <array>
+#include <charconv>
+
+Token_Stream tokens;
+
+struct Keyword {
+	std::string_view name;
+	int token;
+};
+
+static constexpr Keyword keywords[] {
+	{ "def", tok_def }, { "extern", tok_extern }, { "if", tok_if },
+	{ "then", tok_then }, { "else", tok_else }, { "for", tok_for },
+	{ "in", tok_in }, { "binary", tok_binary }, { "unary", tok_unary }
+};
+
+static constexpr std::size_t keyword_hash(std::string_view identifier) {
+	return (
+		static_cast<unsigned char>(identifier.front()) * 6u +
+		static_cast<unsigned char>(identifier.back()) + identifier.size()
+	) & 15u;
+}
 
-#include <iostream>
-
-std::string identifier { };
-double value { 0.0 };
-static int last { ' ' };
-static inline int get() { return std::cin.get(); }
+static constexpr auto keyword_table { [] {
+	std::array<Keyword, 16> table { };
+	for (const auto& keyword : keywords) { table[keyword_hash(keyword.name)] = keyword; }
+	return table;
+}() };
 
-static inline int parse_identifier() {
-	identifier.clear();
-	while (std::isalnum(last)) {
-		identifier += last;
-		last = get();
+static_assert([] {
+	for (const auto& keyword : keywords) {
+		if (keyword_table[keyword_hash(keyword.name)].name != keyword.name) { return false; }
 	}
+	return true;
+}(), "keyword_hash is not perfect for the keyword set");
 
-	if (identifier == "def") { return tok_def; }
-	if (identifier == "extern") { return tok_extern; }
-	if (identifier == "if") { return tok_if; }
-	if (identifier == "then") { return tok_then; }
-	if (identifier == "else") { return tok_else; }
-	if (identifier == "for") { return tok_for; }
-	if (identifier == "in") { return tok_in; }
-	if (identifier == "binary") { return tok_binary; }
-	if (identifier == "unary") { return tok_unary; }
+static inline int keyword(std::string_view identifier) {
+	const auto& candidate { keyword_table[keyword_hash(identifier)] };
+	return candidate.name == identifier ? candidate.token : tok_identifier;
+}
 
-	return tok_identifier;
+void Token_Stream::push(int kind, const char* begin, const char* end, Token_Payload payload) {
+	kinds_.push_back(static_cast<std::int16_t>(kind));
+	offsets_.push_back(static_cast<std::uint32_t>(begin - source.begin()));
+	lengths_.push_back(static_cast<std::uint32_t>(end - begin));
+	payloads_.push_back(payload);
 }
 
-static inline int parse_number() {
-	std::string num;
-	while (std::isdigit(last) || last == '.') {
-		num += last;
-		last = get();
+void Token_Stream::scan(bool at_eof) {
+	auto end { source.end() };
+	auto p { source.begin() + scanned_ };
+	for (;;) {
+		p = scan::skip_space(p, end);
+		if (p == end) { break; }
+		auto start { p };
+		if (scan::is_alpha(*p)) {
+			p = scan::skip_alnum(p + 1, end);
+			if (p == end && ! at_eof) { p = start; break; }
+			std::string_view identifier { start, static_cast<std::size_t>(p - start) };
+			auto kind { keyword(identifier) };
+			if (kind == tok_identifier) {
+				Token_Payload payload;
+				payload.symbol = intern(identifier);
+				push(kind, start, p, payload);
+			} else { push(kind, start, p); }
+		} else if (scan::is_number(*p)) {
+			p = scan::skip_number(p + 1, end);
+			if (p == end && ! at_eof) { p = start; break; }
+			double value;
+			auto [last, error] { std::from_chars(start, p, value) };
+			if (error == std::errc { } && last == p) {
+				push(tok_number, start, p, { value });
+			} else { push(tok_bad_number, start, p); }
+		} else if (*p == '#') {
+			p = scan::skip_comment(p + 1, end);
+			if (p == end && ! at_eof) { p = start; break; }
+		} else {
+			++p;
+			push(static_cast<unsigned char>(*start), start, p);
+		}
 	}
-	value = std::stod(num);
-	return tok_number;
+	scanned_ = static_cast<std::size_t>(p - source.begin());
 }
 
-static int get_tok();
-
-static inline int parse_comment() {
-	while (last != EOF && last >= ' ') { last = get(); }
-	return get_tok();
+void Token_Stream::fill(std::size_t needed) {
+	Phase_Timer timer { Phase::lex };
+	while (! done_ && kinds_.size() <= needed) {
+		auto more { [] {
+			Untimed waiting_for_input;
+			return source.fill();
+		}() };
+		if (more) {
+			scan(false);
+		} else {
+			scan(true);
+			done_ = true;
+		}
+	}
+	while (kinds_.size() <= needed) {
+		auto end { source.end() };
+		push(tok_eof, end, end);
+	}
 }
 
-static int get_tok() {
-	while (std::isspace(last)) { last = get(); }
-
-	if (std::isalpha(last)) { return parse_identifier(); }
-
-	if (std::isdigit(last) || last == '.') { return parse_number(); }
-
-	if (last == '#') { return parse_comment(); }
-
-	if (last == EOF) { return tok_eof; }
-
-	int res { last };
-	last = get();
-	return res;
+void Token_Stream::reset() {
+	kinds_.clear();
+	offsets_.clear();
+	lengths_.clear();
+	payloads_.clear();
+	pos_ = 0;
+	scanned_ = 0;
+	done_ = false;
 }
 
-int cur_tok { 0 };
-
-int next_tok() {
-	cur_tok = get_tok();
-	return cur_tok;
+std::string_view Token_Stream::text(std::size_t ahead) {
+	if (pos_ + ahead >= kinds_.size()) { fill(pos_ + ahead); }
+	return { source.begin() + offsets_[pos_ + ahead], lengths_[pos_ + ahead] };
 }
@@ -1,6 +1,11 @@
 #pragma once
 
-#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "symbol.h"
 
 enum Token {
 	tok_eof = -1,
@@ -14,11 +19,51 @@ enum Token {
 	tok_for = -9,
 	tok_in = -10,
 	tok_binary = -11,
-	tok_unary = -12
+	tok_unary = -12,
+	tok_bad_number = -13
+};
+
+union Token_Payload {
+	double value;
+	Symbol symbol;
 };
 
-extern std::string identifier;
-extern double value;
+class Token_Stream {
+		std::vector<std::int16_t> kinds_;
+		std::vector<std::uint32_t> offsets_;
+		std::vector<std::uint32_t> lengths_;
+		std::vector<Token_Payload> payloads_;
+		std::size_t pos_ { 0 };
+		std::size_t scanned_ { 0 };
+		bool done_ { false };
+
+		void scan(bool at_eof);
+		void push(int kind, const char* begin, const char* end, Token_Payload payload = { });
+		void fill(std::size_t needed);
+
+	public:
+		void reset();
+
+		[[nodiscard]] std::size_t size() const { return kinds_.size(); }
+
+		int kind(std::size_t ahead = 0) {
+			if (pos_ + ahead >= kinds_.size()) { fill(pos_ + ahead); }
+			return kinds_[pos_ + ahead];
+		}
+		std::string_view text(std::size_t ahead = 0);
+		double value(std::size_t ahead = 0) {
+			if (pos_ + ahead >= kinds_.size()) { fill(pos_ + ahead); }
+			return payloads_[pos_ + ahead].value;
+		}
+		Symbol symbol(std::size_t ahead = 0) {
+			if (pos_ + ahead >= kinds_.size()) { fill(pos_ + ahead); }
+			return payloads_[pos_ + ahead].symbol;
+		}
+
+		int next() {
+			if (pos_ < kinds_.size() && kinds_[pos_] != tok_eof) { ++pos_; }
+			return kind();
+		}
+};
 
-extern int cur_tok;
-extern int next_tok();
+extern Token_Stream tokens;